@@ -17,10 +17,44 @@
 #include <float.h>
 #include <cmath>
 #include <limits>
+#include <chrono>
 #include <iostream>
 #include "MarchingCubes.h"
 #include "ply.h"
+#include "mesh_io.h"
+#include "iso_volume.h"
 #include "LookUpTable.h"
+#include "trace.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif // _MSC_VER
+
+//_____________________________________________________________________________
+// index of the lowest set bit of a non null word
+static inline int lowest_bit( uint64_t m )
+{
+#ifdef _MSC_VER
+  unsigned long b ;
+  _BitScanForward64( &b, m ) ;
+  return (int)b ;
+#else  // _MSC_VER
+  return __builtin_ctzll( m ) ;
+#endif // _MSC_VER
+}
+//_____________________________________________________________________________
+
+//_____________________________________________________________________________
+// bits of the word w for the indices lo <= i <= hi
+static inline uint64_t bit_range( int lo, int hi, int w )
+{
+  lo -= 64*w ;  hi -= 64*w ;
+  if( hi < 0 || lo > 63 || hi < lo ) return 0 ;
+  return ( ~(uint64_t)0 >> ( 63 - std::min( hi, 63 ) ) ) & ( ~(uint64_t)0 << std::max( lo, 0 ) ) ;
+}
+//_____________________________________________________________________________
 
 //_____________________________________________________________________________
 // print cube for debug
@@ -37,12 +71,36 @@ void print_cube(float *cube) {
 
 //_____________________________________________________________________________
 // Constructor
-MarchingCubes::MarchingCubes( const int size_x /*= -1*/, const int size_y /*= -1*/, const int size_z /*= -1*/ ) :
+MarchingCubes::MarchingCubes( const int size_x /*= -1*/, const int size_y /*= -1*/, const int size_z /*= -1*/, MemoryResource *resource /*= NULL*/ ) :
 //-----------------------------------------------------------------------------
   _originalMC(false),
+  _gradient(nullptr),
+  _transform(1.0f),
+  _inverse(1.0f),
+  _normal_map(1.0f),
+  _transformed(false),
   _size_x(size_x),
   _size_y(size_y),
-  _size_z(size_z)
+  _size_z(size_z),
+  _data(resource),
+  _brick(8),
+  _bricks(1),
+  _lo(0),
+  _hi(size_x-1, size_y-1, size_z-1),
+  _offset(0),
+  _keyed(false),
+  _global(0),
+  _signs(resource),
+  _sign_words(0),
+  _x_verts(resource),
+  _y_verts(resource),
+  _z_verts(resource),
+  _touched(resource),
+  _vertices(resource),
+  _triangles(resource),
+  _keys(resource),
+  _nverts_hint(0),
+  _ntrigs_hint(0)
 {}
 //_____________________________________________________________________________
 
@@ -53,29 +111,231 @@ MarchingCubes::MarchingCubes( const int size_x /*= -1*/, const int size_y /*= -1
 void MarchingCubes::run( real iso )
 //-----------------------------------------------------------------------------
 {
-  clock_t time = clock() ;
-
+  MC_TRACE_SPAN( "run" ) ;
+#if MC_STATS
+  typedef std::chrono::steady_clock clk ;
+  _stats.clear() ;
+  const clk::time_point t0 = clk::now() ;
+  compute_signs( iso ) ;
+  const clk::time_point t1 = clk::now() ;
   compute_intersection_points( iso ) ;
+  const clk::time_point t2 = clk::now() ;
+  tesselate( iso ) ;
+  const clk::time_point t3 = clk::now() ;
+  _stats.signs_secs        = std::chrono::duration<double>( t1 - t0 ).count() ;
+  _stats.intersection_secs = std::chrono::duration<double>( t2 - t1 ).count() ;
+  _stats.tesselation_secs  = std::chrono::duration<double>( t3 - t2 ).count() ;
+  finish_stats() ;
+#else  // MC_STATS
+  compute_signs( iso ) ;
+  compute_intersection_points( iso ) ;
+  tesselate( iso ) ;
+#endif // MC_STATS
+}
+//_____________________________________________________________________________
 
-  for( _k = 0 ; _k < _size_z-1 ; _k++ )
-  for( _j = 0 ; _j < _size_y-1 ; _j++ )
-  for( _i = 0 ; _i < _size_x-1 ; _i++ )
+
+
+//_____________________________________________________________________________
+// counters of the statistics
+void MarchingCubes::finish_stats()
+//-----------------------------------------------------------------------------
+{
+  _stats.vertices  = _vertices .size() ;
+  _stats.triangles = _triangles.size() ;
+  _stats.bytes     = _data.capacity() * sizeof(float) + _signs.capacity() * sizeof(uint64_t) + _skip.capacity()
+                   + ( _x_verts.capacity() + _y_verts.capacity() + _z_verts.capacity() ) * sizeof(int) + _touched.capacity() * sizeof(size_t)
+                   + _vertices.capacity() * sizeof(Vertex) + _triangles.capacity() * sizeof(Triangle) + _keys.capacity() * sizeof(int64_t) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// tesselation of the cubes
+void MarchingCubes::tesselate( real iso )
+//-----------------------------------------------------------------------------
+{
+  MC_TRACE_SPAN( "tesselation" ) ;
+  // cubes of the region by bricks, without the bricks of constant sign
+  const int B = brick_edge() ;
+  const int nbx = brick_count( _hi.x-_lo.x+1, B ), nby = brick_count( _hi.y-_lo.y+1, B ), nbz = brick_count( _hi.z-_lo.z+1, B ) ;
+  for( int bk = 0 ; bk < nbz ; ++bk )
+  for( int bj = 0 ; bj < nby ; ++bj )
+  for( int bi = 0 ; bi < nbx ; ++bi )
   {
-		float cube[8];
-    _lut_entry = 0 ;
-    for( int p = 0 ; p < 8 ; ++p )
+  if( brick_skipped( bi, bj, bk ) ) continue ;
+
+  // rows of cubes by words of 64, only the cubes whose corners are not all of the same sign are loaded
+  const int i0 = _lo.x + bi*B, i1 = std::min( _lo.x + (bi+1)*B, _hi.x ) ;
+  if( i1 <= i0 ) continue ;
+  for( _k = _lo.z + bk*B ; _k < std::min( _lo.z + (bk+1)*B, _hi.z ) ; _k++ )
+  for( _j = _lo.y + bj*B ; _j < std::min( _lo.y + (bj+1)*B, _hi.y ) ; _j++ )
+  {
+    const uint64_t *r00 = sign_row( _j, _k ), *r10 = sign_row( _j+1, _k ), *r01 = sign_row( _j, _k+1 ), *r11 = sign_row( _j+1, _k+1 ) ;
+    for( int w = i0 >> 6 ; w <= ( i1-1 ) >> 6 ; ++w )
     {
-			cube[p] = get_data(glm::ivec3(_i+((p^(p>>1))&1), _j+((p>>1)&1), _k+((p>>2)&1))) - iso ;
-			if( std::abs( cube[p] ) < std::numeric_limits<float>::epsilon() ) {
-				cube[p] = std::numeric_limits<float>::epsilon() ;
-			}
-			if( cube[p] > 0 ) _lut_entry += 1 << p ;
+      // corners of the cube i in bit i of the lower samples, and of the next cube for the upper samples
+      const uint64_t all = r00[w] & r10[w] & r01[w] & r11[w] ;
+      const uint64_t any = r00[w] | r10[w] | r01[w] | r11[w] ;
+      const int      nw  = w+1 < _sign_words ? w+1 : w ;
+      const uint64_t all_next = ( all >> 1 ) | ( nw != w ? ( r00[nw] & r10[nw] & r01[nw] & r11[nw] ) << 63 : 0 ) ;
+      const uint64_t any_next = ( any >> 1 ) | ( nw != w ? ( r00[nw] | r10[nw] | r01[nw] | r11[nw] ) << 63 : 0 ) ;
+      uint64_t mixed = ~( ( all & all_next ) | ~( any | any_next ) ) & bit_range( i0, i1-1, w ) ;
+      for( ; mixed ; mixed &= mixed - 1 )
+      {
+        _i = 64*w + lowest_bit( mixed ) ;
+        float cube[8];
+        load_cube( cube, iso ) ;
+        process_cube(cube) ;
+      }
     }
+  }
+  }
+}
+//_____________________________________________________________________________
+
+
 
-    process_cube(cube) ;
+//_____________________________________________________________________________
+// surface tracking
+int MarchingCubes::run_seeded( real iso, const std::vector<glm::ivec3> &seeds, int stride )
+//-----------------------------------------------------------------------------
+{
+  MC_TRACE_SPAN( "run_seeded" ) ;
+  MC_STAT( _stats.clear() )
+#if MC_STATS
+  const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now() ;
+#endif // MC_STATS
+
+  // cubes of the region, marked once queued
+  const glm::ivec3 n = _hi - _lo ;
+  if( n.x < 1 || n.y < 1 || n.z < 1 ) return 0 ;
+  std::vector<uint64_t> queued( ( (size_t)n.x * n.y * n.z + 63 ) / 64, 0 ) ;
+  std::vector<glm::ivec3> stack ;
+  auto push = [&]( const glm::ivec3 &c )
+  {
+    const glm::ivec3 l = c - _lo ;
+    if( l.x < 0 || l.y < 0 || l.z < 0 || l.x >= n.x || l.y >= n.y || l.z >= n.z ) return ;
+    const size_t id = l.x + n.x * ( l.y + (size_t)n.y * l.z ) ;
+    if( queued[id >> 6] & ( (uint64_t)1 << ( id & 63 ) ) ) return ;
+    queued[id >> 6] |= (uint64_t)1 << ( id & 63 ) ;
+    stack.push_back( c ) ;
+  } ;
+
+  if( !seeds.empty() )
+    for( const glm::ivec3 &c : seeds ) push( c ) ;
+  else
+  {
+    // sign changes along lines of samples spaced by stride in the two other directions, for each axis
+    stride = std::max( stride, 1 ) ;
+    for( int a = 0 ; a < 3 ; ++a )
+    {
+      const int b = ( a + 1 ) % 3, c = ( a + 2 ) % 3 ;
+      for( int v = _lo[c] ; v <= _hi[c] ; v += stride )
+      for( int u = _lo[b] ; u <= _hi[b] ; u += stride )
+      {
+        glm::ivec3 p ;
+        p[b] = u ;  p[c] = v ;  p[a] = _lo[a] ;
+        bool neg = get_data( p ) - iso <= -std::numeric_limits<float>::epsilon() ;
+        for( ; p[a] < _hi[a] ; )
+        {
+          glm::ivec3 q = p ;
+          ++q[a] ;
+          const bool qneg = get_data( q ) - iso <= -std::numeric_limits<float>::epsilon() ;
+          if( qneg != neg )
+          {
+            // one of the cubes sharing the edge, inside the region
+            glm::ivec3 cube = p ;
+            cube[b] = std::min( u, _hi[b] - 1 ) ;
+            cube[c] = std::min( v, _hi[c] - 1 ) ;
+            push( cube ) ;
+          }
+          neg = qneg ;
+          p   = q ;
+        }
+      }
+    }
+  }
+
+  // flood fill through the faces whose corners change sign
+  static const uchar faces[6] = { 0x99, 0x66, 0x33, 0xCC, 0x0F, 0xF0 } ;
+  static const int   steps[6][3] = { {-1,0,0}, {1,0,0}, {0,-1,0}, {0,1,0}, {0,0,-1}, {0,0,1} } ;
+  int ncubes = 0 ;
+  while( !stack.empty() )
+  {
+    const glm::ivec3 c = stack.back() ;
+    stack.pop_back() ;
+    _i = c.x ;  _j = c.y ;  _k = c.z ;
+
+    float cube[8] ;
+    load_cube( cube, iso ) ;
+    if( _lut_entry == 0 || _lut_entry == 255 ) continue ;
+
+    add_cube_vertices( cube ) ;
+    process_cube( cube ) ;
+    ++ncubes ;
+
+    for( int f = 0 ; f < 6 ; ++f )
+    {
+      const uchar s = _lut_entry & faces[f] ;
+      if( s != 0 && s != faces[f] ) push( c + glm::ivec3( steps[f][0], steps[f][1], steps[f][2] ) ) ;
+    }
   }
 
-	std::cout << "Marching Cubes ran in " << ((double)(clock() - time)/CLOCKS_PER_SEC) << " secs.\n";
+  MC_STAT( _stats.tesselation_secs = std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count() ;  finish_stats() )
+  return ncubes ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// PLY exportation of the generated mesh
+bool MarchingCubes::writePLY( const char *fn ) const
+//-----------------------------------------------------------------------------
+{
+  MC_TRACE_SPAN( "writePLY" ) ;
+  return MeshWriter::write( fn, MeshWriter::PLY, _vertices.data(), _vertices.size(), _triangles.data(), _triangles.size() ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// STL exportation of the generated mesh
+bool MarchingCubes::writeSTL( const char *fn ) const
+//-----------------------------------------------------------------------------
+{
+  MC_TRACE_SPAN( "writeSTL" ) ;
+  return MeshWriter::write( fn, MeshWriter::STL, _vertices.data(), _vertices.size(), _triangles.data(), _triangles.size() ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// PLY importation of a mesh
+bool MarchingCubes::readPLY( const char *fn )
+//-----------------------------------------------------------------------------
+{
+  MC_TRACE_SPAN( "readPLY" ) ;
+  _keys.clear() ;
+  return MeshReader::read( fn, _vertices, _triangles ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// ISO exportation of the grid
+bool MarchingCubes::writeISO( const char *fn, const float bounds[6], int brick, real iso ) const
+//-----------------------------------------------------------------------------
+{
+  MC_TRACE_SPAN( "writeISO" ) ;
+  static const float unit[6] = { -1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f } ;
+  const int size[3] = { _size_x, _size_y, _size_z } ;
+  return IsoVolume::write( fn, _data.data(), size, bounds ? bounds : unit, brick, IsoVolume::F32, true, iso ) ;
 }
 //_____________________________________________________________________________
 
@@ -86,14 +346,9 @@ void MarchingCubes::run( real iso )
 void MarchingCubes::init_temps()
 //-----------------------------------------------------------------------------
 {
-	_data.resize(_size_x * _size_y * _size_z);
-	_x_verts.resize(_size_x * _size_y * _size_z);
-	_y_verts.resize(_size_x * _size_y * _size_z);
-	_z_verts.resize(_size_x * _size_y * _size_z);
-	
-	memset( _x_verts.data(), -1, _x_verts.size() * sizeof( int ) ) ;
-  memset( _y_verts.data(), -1, _y_verts.size() * sizeof( int ) ) ;
-  memset( _z_verts.data(), -1, _z_verts.size() * sizeof( int ) ) ;
+	_data.resize((size_t)_size_x * _size_y * _size_z);
+  clear_edges() ;
+  _skip.clear() ;
 }
 //_____________________________________________________________________________
 
@@ -105,6 +360,277 @@ void MarchingCubes::init_all ()
 //-----------------------------------------------------------------------------
 {
   init_temps();
+  clear_mesh() ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// clears the results of the previous run, keeping the samples
+void MarchingCubes::reset ()
+//-----------------------------------------------------------------------------
+{
+  clear_edges() ;
+  _skip.clear() ;
+  clear_mesh() ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// unsets the vertex indices
+void MarchingCubes::clear_edges()
+//-----------------------------------------------------------------------------
+{
+  // the indices set by the previous runs, unless they are so many that filling the whole grid is faster
+  const size_t n = (size_t)_size_x * _size_y * _size_z ;
+  if( _touched.size() > _x_verts.size() / 8 )
+  {
+    std::fill( _x_verts.begin(), _x_verts.end(), -1 ) ;
+    std::fill( _y_verts.begin(), _y_verts.end(), -1 ) ;
+    std::fill( _z_verts.begin(), _z_verts.end(), -1 ) ;
+  }
+  else
+  {
+    int *verts[3] = { _x_verts.data(), _y_verts.data(), _z_verts.data() } ;
+    for( const size_t e : _touched ) verts[ e % 3 ][ e / 3 ] = -1 ;
+  }
+  _touched.clear() ;
+
+  // a grid of another size keeps the allocation when smaller, the new indices being unset
+  _x_verts.resize( n, -1 ) ;
+  _y_verts.resize( n, -1 ) ;
+  _z_verts.resize( n, -1 ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// clears the mesh buffers
+void MarchingCubes::clear_mesh()
+//-----------------------------------------------------------------------------
+{
+  // the last mesh hints at the size of the next one, even when its buffers have been handed over
+  if( !_vertices .empty() ) _nverts_hint = _vertices .size() ;
+  if( !_triangles.empty() ) _ntrigs_hint = _triangles.size() ;
+  _vertices .clear() ;
+  _triangles.clear() ;
+  _keys     .clear() ;
+  _vertices .reserve( _nverts_hint ) ;
+  _triangles.reserve( _ntrigs_hint ) ;
+  if( _keyed ) _keys.reserve( _nverts_hint ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// hands the mesh over
+MCMesh MarchingCubes::take_mesh()
+//-----------------------------------------------------------------------------
+{
+  if( !_vertices .empty() ) _nverts_hint = _vertices .size() ;
+  if( !_triangles.empty() ) _ntrigs_hint = _triangles.size() ;
+
+  // the buffers are moved with their resource, the emptied ones keeping it for the next run
+  MCMesh m ;
+  m.vertices  = std::move( _vertices  ) ;
+  m.triangles = std::move( _triangles ) ;
+  m.keys      = std::move( _keys      ) ;
+  _vertices .clear() ;
+  _triangles.clear() ;
+  _keys     .clear() ;
+  return m ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// fills the grid coarse to fine
+int MarchingCubes::sample_adaptive( const SampleFunction &f, real iso, real lipschitz, real margin, int brick )
+//-----------------------------------------------------------------------------
+{
+  MC_TRACE_SPAN( "sample_adaptive" ) ;
+  _skip.clear() ;
+  _brick  = std::max( brick, 1 ) ;
+  const glm::ivec3 size( _size_x, _size_y, _size_z ) ;
+  const int B = _brick ;
+  _bricks = glm::ivec3( brick_count( _size_x, B ), brick_count( _size_y, B ), brick_count( _size_z, B ) ) ;
+  const glm::ivec3 nc = _bricks + 1 ;
+  std::vector<float> tmp ;
+
+  // corners of the bricks, clamped to the grid : a regular lattice, plus the last samples when the grid is not a
+  // multiple of the bricks
+  std::vector<float> corner( nc.x * nc.y * nc.z ) ;
+  int seg_first[3][2], seg_stride[3][2], seg_n[3][2], seg_pos[3][2], nseg[3] ;
+  for( int a = 0 ; a < 3 ; ++a )
+  {
+    const int n = ( size[a] - 1 ) / B + 1 ;
+    seg_first[a][0] = 0 ;  seg_stride[a][0] = B ;  seg_n[a][0] = n ;  seg_pos[a][0] = 0 ;
+    seg_first[a][1] = size[a] - 1 ;  seg_stride[a][1] = 1 ;  seg_n[a][1] = 1 ;  seg_pos[a][1] = n ;
+    nseg[a] = ( n < nc[a] ) ? 2 : 1 ;
+  }
+  for( int sk = 0 ; sk < nseg[2] ; ++sk )
+  for( int sj = 0 ; sj < nseg[1] ; ++sj )
+  for( int si = 0 ; si < nseg[0] ; ++si )
+  {
+    const glm::ivec3 first ( seg_first [0][si], seg_first [1][sj], seg_first [2][sk] ) ;
+    const glm::ivec3 stride( seg_stride[0][si], seg_stride[1][sj], seg_stride[2][sk] ) ;
+    const glm::ivec3 n     ( seg_n     [0][si], seg_n     [1][sj], seg_n     [2][sk] ) ;
+    const glm::ivec3 pos   ( seg_pos   [0][si], seg_pos   [1][sj], seg_pos   [2][sk] ) ;
+    tmp.resize( n.x * n.y * n.z ) ;
+    f( first, stride, n, tmp.data() ) ;
+    for( int k = 0 ; k < n.z ; ++k )
+    for( int j = 0 ; j < n.y ; ++j )
+    for( int i = 0 ; i < n.x ; ++i )
+      corner[ (pos.x+i) + nc.x * ( (pos.y+j) + nc.y * (pos.z+k) ) ] = tmp[ i + n.x * ( j + n.y * k ) ] ;
+  }
+
+  // bricks whose corners have the same sign, far enough from the isovalue
+  std::vector<uchar> skip( _bricks.x * _bricks.y * _bricks.z ) ;
+  int nskip = 0 ;
+  for( int bk = 0 ; bk < _bricks.z ; ++bk )
+  for( int bj = 0 ; bj < _bricks.y ; ++bj )
+  for( int bi = 0 ; bi < _bricks.x ; ++bi )
+  {
+    const glm::ivec3 lo( bi*B, bj*B, bk*B ) ;
+    const glm::vec3  d ( glm::min( lo + B, size - 1 ) - lo ) ;
+    const real half = (real)0.5 * std::sqrt( d.x*d.x + d.y*d.y + d.z*d.z ) ;
+
+    bool pos = false, neg = false ;
+    real dmin = std::numeric_limits<real>::max() ;
+    for( int p = 0 ; p < 8 ; ++p )
+    {
+      // same sign convention as run
+      const real c = corner[ (bi+(p&1)) + nc.x * ( (bj+((p>>1)&1)) + nc.y * (bk+((p>>2)&1)) ) ] - iso ;
+      if( c <= -std::numeric_limits<float>::epsilon() ) neg = true ; else pos = true ;
+      dmin = std::min( dmin, std::abs( c ) ) ;
+    }
+
+    const bool s = !( pos && neg ) && dmin > lipschitz * half + margin ;
+    skip[ bi + _bricks.x * ( bj + _bricks.y * bk ) ] = s ;
+    nskip += s ;
+  }
+
+  // interpolates the skipped bricks from their corners
+  for( int bk = 0 ; bk < _bricks.z ; ++bk )
+  for( int bj = 0 ; bj < _bricks.y ; ++bj )
+  for( int bi = 0 ; bi < _bricks.x ; ++bi )
+  {
+    if( !skip[ bi + _bricks.x * ( bj + _bricks.y * bk ) ] ) continue ;
+
+    const glm::ivec3 lo( bi*B, bj*B, bk*B ) ;
+    const glm::ivec3 hi = glm::min( lo + B, size - 1 ) ;
+    float c[8] ;
+    for( int p = 0 ; p < 8 ; ++p )
+      c[p] = corner[ (bi+(p&1)) + nc.x * ( (bj+((p>>1)&1)) + nc.y * (bk+((p>>2)&1)) ) ] ;
+
+    for( int k = lo.z ; k <= hi.z ; ++k )
+    for( int j = lo.y ; j <= hi.y ; ++j )
+    for( int i = lo.x ; i <= hi.x ; ++i )
+    {
+      const float u = (float)(i-lo.x) / (hi.x-lo.x), v = (float)(j-lo.y) / (hi.y-lo.y), w = (float)(k-lo.z) / (hi.z-lo.z) ;
+      const float c0 = ( c[0]*(1-u) + c[1]*u ) * (1-v) + ( c[2]*(1-u) + c[3]*u ) * v ;
+      const float c1 = ( c[4]*(1-u) + c[5]*u ) * (1-v) + ( c[6]*(1-u) + c[7]*u ) * v ;
+      set_data( c0*(1-w) + c1*w, i,j,k ) ;
+    }
+  }
+
+  // evaluates the other bricks
+  sample_bricks( f, skip ) ;
+
+  _skip.swap( skip ) ;
+  return nskip ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// fills the grid by bricks, bounded by range
+int MarchingCubes::sample_bounded( const SampleFunction &f, const RangeFunction &range, real iso, real margin, int brick )
+//-----------------------------------------------------------------------------
+{
+  MC_TRACE_SPAN( "sample_bounded" ) ;
+  _skip.clear() ;
+  _brick  = std::max( brick, 1 ) ;
+  const glm::ivec3 size( _size_x, _size_y, _size_z ) ;
+  const int B = _brick ;
+  _bricks = glm::ivec3( brick_count( _size_x, B ), brick_count( _size_y, B ), brick_count( _size_z, B ) ) ;
+
+  // bricks whose range is on one side of the isovalue, filled with the bound nearest to it
+  std::vector<uchar> skip( _bricks.x * _bricks.y * _bricks.z ) ;
+  int nskip = 0 ;
+  for( int bk = 0 ; bk < _bricks.z ; ++bk )
+  for( int bj = 0 ; bj < _bricks.y ; ++bj )
+  for( int bi = 0 ; bi < _bricks.x ; ++bi )
+  {
+    const glm::ivec3 lo( bi*B, bj*B, bk*B ) ;
+    const glm::ivec3 hi = glm::min( lo + B, size - 1 ) ;
+    float vmin, vmax ;
+    range( lo, hi, vmin, vmax ) ;
+
+    // same sign convention as run
+    real fill ;
+    if     ( vmin - iso > margin && vmin - iso > -std::numeric_limits<float>::epsilon() ) fill = vmin ;
+    else if( iso - vmax > margin && vmax - iso <= -std::numeric_limits<float>::epsilon() ) fill = vmax ;
+    else continue ;
+
+    skip[ bi + _bricks.x * ( bj + _bricks.y * bk ) ] = 1 ;
+    ++nskip ;
+    for( int k = lo.z ; k <= hi.z ; ++k )
+    for( int j = lo.y ; j <= hi.y ; ++j )
+    for( int i = lo.x ; i <= hi.x ; ++i )
+      set_data( fill, i,j,k ) ;
+  }
+
+  // evaluates the other bricks
+  sample_bricks( f, skip ) ;
+
+  _skip.swap( skip ) ;
+  return nskip ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// evaluates the bricks that are not skipped
+void MarchingCubes::sample_bricks( const SampleFunction &f, const std::vector<uchar> &skip )
+//-----------------------------------------------------------------------------
+{
+  const glm::ivec3 size( _size_x, _size_y, _size_z ) ;
+  const int B = _brick ;
+  std::vector<float> tmp ;
+
+  // the far faces are left to the next brick when it is evaluated too
+  for( int bk = 0 ; bk < _bricks.z ; ++bk )
+  for( int bj = 0 ; bj < _bricks.y ; ++bj )
+  for( int bi = 0 ; bi < _bricks.x ; ++bi )
+  {
+    if( skip[ bi + _bricks.x * ( bj + _bricks.y * bk ) ] ) continue ;
+
+    const glm::ivec3 b( bi, bj, bk ) ;
+    const glm::ivec3 lo = b * B ;
+    glm::ivec3 hi = glm::min( lo + B, size - 1 ) ;
+    for( int a = 0 ; a < 3 ; ++a )
+    {
+      glm::ivec3 nb = b ;
+      if( ++nb[a] < _bricks[a] && !skip[ nb.x + _bricks.x * ( nb.y + _bricks.y * nb.z ) ] ) --hi[a] ;
+    }
+
+    const glm::ivec3 n = hi - lo + 1 ;
+    tmp.resize( n.x * n.y * n.z ) ;
+    f( lo, glm::ivec3(1), n, tmp.data() ) ;
+    for( int k = 0 ; k < n.z ; ++k )
+    for( int j = 0 ; j < n.y ; ++j )
+    for( int i = 0 ; i < n.x ; ++i )
+      set_data( tmp[ i + n.x * ( j + n.y * k ) ], lo.x+i, lo.y+j, lo.z+k ) ;
+  }
 }
 //_____________________________________________________________________________
 
@@ -119,38 +645,42 @@ void MarchingCubes::init_all ()
 void MarchingCubes::compute_intersection_points( real iso )
 //-----------------------------------------------------------------------------
 {
-	for(int _k=0; _k < _size_z; ++_k) {
-		for(int _j=0; _j < _size_y; ++_j) {
-			for(int _i=0; _i < _size_x; ++_i) {
-				auto grid_coord = glm::ivec3(_i, _j, _k);
-			
-				float cube[8];
-				cube[0] = get_data(grid_coord) - iso ;
-				if( _i < _size_x - 1 ) cube[1] = get_data(glm::ivec3(_i+1, _j, _k)) - iso ;
-				else                   cube[1] = cube[0] ;
-
-				if( _j < _size_y - 1 ) cube[3] = get_data(glm::ivec3(_i, _j+1, _k)) - iso ;
-				else                   cube[3] = cube[0] ;
-
-				if( _k < _size_z - 1 ) cube[4] = get_data(glm::ivec3(_i, _j ,_k+1)) - iso ;
-				else                   cube[4] = cube[0] ;
-
-				if( std::abs( cube[0] ) < std::numeric_limits<float>::epsilon() ) cube[0] = std::numeric_limits<float>::epsilon() ;
-				if( std::abs( cube[1] ) < std::numeric_limits<float>::epsilon() ) cube[1] = std::numeric_limits<float>::epsilon() ;
-				if( std::abs( cube[3] ) < std::numeric_limits<float>::epsilon() ) cube[3] = std::numeric_limits<float>::epsilon() ;
-				if( std::abs( cube[4] ) < std::numeric_limits<float>::epsilon() ) cube[4] = std::numeric_limits<float>::epsilon() ;
-
-				if( cube[0] < 0 )
-				{
-					if( cube[1] > 0 ) set_x_vert( add_vertex(grid_coord, glm::ivec3(1, 0, 0), 1, cube), _i,_j,_k ) ;
-					if( cube[3] > 0 ) set_y_vert( add_vertex(grid_coord, glm::ivec3(0, 1, 0), 3, cube), _i,_j,_k ) ;
-					if( cube[4] > 0 ) set_z_vert( add_vertex(grid_coord, glm::ivec3(0, 0, 1), 4, cube), _i,_j,_k ) ;
-				}
-				else
-				{
-					if( cube[1] < 0 ) set_x_vert( add_vertex(grid_coord, glm::ivec3(1, 0, 0), 1, cube), _i,_j,_k ) ;
-					if( cube[3] < 0 ) set_y_vert( add_vertex(grid_coord, glm::ivec3(0, 1, 0), 3, cube), _i,_j,_k ) ;
-					if( cube[4] < 0 ) set_z_vert( add_vertex(grid_coord, glm::ivec3(0, 0, 1), 4, cube), _i,_j,_k ) ;
+  MC_TRACE_SPAN( "intersection" ) ;
+	// samples of the region by rows : only the samples with a sign change along one of their edges are loaded
+	for(int _k=_lo.z; _k <= _hi.z; ++_k) {
+		for(int _j=_lo.y; _j <= _hi.y; ++_j) {
+			const uint64_t *row  = sign_row( _j, _k ) ;
+			const uint64_t *rowy = sign_row( _j < _hi.y ? _j+1 : _j, _k ) ;
+			const uint64_t *rowz = sign_row( _j, _k < _hi.z ? _k+1 : _k ) ;
+			for(int w = _lo.x >> 6; w <= _hi.x >> 6; ++w) {
+				const uint64_t next = ( row[w] >> 1 ) | ( w+1 < _sign_words ? row[w+1] << 63 : 0 ) ;
+				const uint64_t cx = ( row[w] ^ next    ) & bit_range( _lo.x, _hi.x-1, w ) ;
+				const uint64_t cy = ( row[w] ^ rowy[w] ) & bit_range( _lo.x, _hi.x  , w ) ;
+				const uint64_t cz = ( row[w] ^ rowz[w] ) & bit_range( _lo.x, _hi.x  , w ) ;
+
+				for(uint64_t m = cx | cy | cz; m; m &= m - 1) {
+					const int b  = lowest_bit( m ) ;
+					const int _i = 64*w + b ;
+					auto grid_coord = glm::ivec3(_i, _j, _k);
+
+					float cube[8];
+					cube[0] = get_data(grid_coord) - iso ;
+					if( std::abs( cube[0] ) < std::numeric_limits<float>::epsilon() ) cube[0] = std::numeric_limits<float>::epsilon() ;
+					if( ( cx >> b ) & 1 ) {
+						cube[1] = get_data(glm::ivec3(_i+1, _j, _k)) - iso ;
+						if( std::abs( cube[1] ) < std::numeric_limits<float>::epsilon() ) cube[1] = std::numeric_limits<float>::epsilon() ;
+						set_x_vert( add_vertex(grid_coord, glm::ivec3(1, 0, 0), 1, cube), _i,_j,_k ) ;
+					}
+					if( ( cy >> b ) & 1 ) {
+						cube[3] = get_data(glm::ivec3(_i, _j+1, _k)) - iso ;
+						if( std::abs( cube[3] ) < std::numeric_limits<float>::epsilon() ) cube[3] = std::numeric_limits<float>::epsilon() ;
+						set_y_vert( add_vertex(grid_coord, glm::ivec3(0, 1, 0), 3, cube), _i,_j,_k ) ;
+					}
+					if( ( cz >> b ) & 1 ) {
+						cube[4] = get_data(glm::ivec3(_i, _j ,_k+1)) - iso ;
+						if( std::abs( cube[4] ) < std::numeric_limits<float>::epsilon() ) cube[4] = std::numeric_limits<float>::epsilon() ;
+						set_z_vert( add_vertex(grid_coord, glm::ivec3(0, 0, 1), 4, cube), _i,_j,_k ) ;
+					}
 				}
 			}
 		}
@@ -160,13 +690,38 @@ void MarchingCubes::compute_intersection_points( real iso )
 
 
 
-
-
+//_____________________________________________________________________________
+// Classify the samples
+void MarchingCubes::compute_signs( real iso )
+//-----------------------------------------------------------------------------
+{
+  MC_TRACE_SPAN( "signs" ) ;
+  // a sample is positive once moved away from 0 if it exceeds -epsilon, as in load_cube
+  const float eps = std::numeric_limits<float>::epsilon() ;
+  _sign_words = ( _size_x + 63 ) / 64 ;
+  _signs.assign( (size_t)_sign_words * _size_y * _size_z, 0 ) ;
+  for( int k = 0 ; k < _size_z ; ++k )
+  for( int j = 0 ; j < _size_y ; ++j )
+  {
+    const float *row  = _data.data() + ( j + (size_t)_size_y * k ) * _size_x ;
+    uint64_t    *bits = _signs.data() + ( j + (size_t)_size_y * k ) * _sign_words ;
+    int i = 0 ;
+#ifdef __SSE2__
+    // four samples per comparison, never straddling two words
+    const __m128 viso = _mm_set1_ps( iso ), veps = _mm_set1_ps( -eps ) ;
+    for( ; i + 4 <= _size_x ; i += 4 )
+      bits[i >> 6] |= (uint64_t)_mm_movemask_ps( _mm_cmpgt_ps( _mm_sub_ps( _mm_loadu_ps( row + i ), viso ), veps ) ) << ( i & 63 ) ;
+#endif // __SSE2__
+    for( ; i < _size_x ; ++i )
+      if( row[i] - iso > -eps ) bits[i >> 6] |= (uint64_t)1 << ( i & 63 ) ;
+  }
+}
 //_____________________________________________________________________________
 // tests if the components of the tesselation of the cube should be connected by the interior of an ambiguous face
 // Test a face
 // if face>0 return true if the face contains a part of the surface
-bool test_face( schar face, float *cube ) {
+bool MarchingCubes::test_face( schar face, float *cube ) {
+  MC_STAT( ++_stats.face_tests )
   static int corner_lookup[6][4] = {
 		{0, 4, 5, 1},
 		{1, 5, 6, 2},
@@ -202,6 +757,7 @@ bool test_face( schar face, float *cube ) {
 bool MarchingCubes::test_interior( schar s, float *cube )
 //-----------------------------------------------------------------------------
 {
+  MC_STAT( ++_stats.interior_tests )
   real t, At=0, Bt=0, Ct=0, Dt=0, a, b ;
   char  test =  0 ;
   char  edge = -1 ; // reference edge of the triangulation
@@ -362,6 +918,7 @@ bool MarchingCubes::test_interior( schar s, float *cube )
 void MarchingCubes::process_cube(float *cube)
 //-----------------------------------------------------------------------------
 {
+  MC_STAT( ++_stats.cubes ;  ++_stats.cases[ (int)cases[_lut_entry][0] ] )
   if( _originalMC )
   {
     char nt = 0 ;
@@ -528,6 +1085,14 @@ void MarchingCubes::process_cube(float *cube)
     if( test_face( test13[_config][3], cube ) ) _subconfig +=  8 ;
     if( test_face( test13[_config][4], cube ) ) _subconfig += 16 ;
     if( test_face( test13[_config][5], cube ) ) _subconfig += 32 ;
+#if MC_STATS
+    {
+      // 13.5 is split by its interior test below
+      const int s = subconfig13[_subconfig] ;
+      if( s < 23 || s > 26 )
+        ++_stats.subcases13[ ( s == 0 || s == 45 ) ? MCStats::S13_1 : ( s <= 6 || s >= 39 ) ? MCStats::S13_2 : ( s <= 18 || s >= 27 ) ? MCStats::S13_3 : MCStats::S13_4 ] ;
+    }
+#endif // MC_STATS
     switch( subconfig13[_subconfig] )
     {
       case 0 :/* 13.1 */
@@ -599,30 +1164,30 @@ void MarchingCubes::process_cube(float *cube)
       case 23 :/* 13.5 */
         _subconfig = 0 ;
         if( test_interior( test13[_config][6], cube ) )
-          add_triangle( tiling13_5_1[_config][0], 6 ) ;
+        { MC_STAT( ++_stats.subcases13[MCStats::S13_5_1] )  add_triangle( tiling13_5_1[_config][0], 6 ) ; }
         else
-          add_triangle( tiling13_5_2[_config][0], 10 ) ;
+        { MC_STAT( ++_stats.subcases13[MCStats::S13_5_2] )  add_triangle( tiling13_5_2[_config][0], 10 ) ; }
         break ;
       case 24 :/* 13.5 */
         _subconfig = 1 ;
         if( test_interior( test13[_config][6], cube ) )
-          add_triangle( tiling13_5_1[_config][1], 6 ) ;
+        { MC_STAT( ++_stats.subcases13[MCStats::S13_5_1] )  add_triangle( tiling13_5_1[_config][1], 6 ) ; }
         else
-          add_triangle( tiling13_5_2[_config][1], 10 ) ;
+        { MC_STAT( ++_stats.subcases13[MCStats::S13_5_2] )  add_triangle( tiling13_5_2[_config][1], 10 ) ; }
         break ;
       case 25 :/* 13.5 */
         _subconfig = 2 ;
         if( test_interior( test13[_config][6], cube ) )
-          add_triangle( tiling13_5_1[_config][2], 6 ) ;
+        { MC_STAT( ++_stats.subcases13[MCStats::S13_5_1] )  add_triangle( tiling13_5_1[_config][2], 6 ) ; }
         else
-          add_triangle( tiling13_5_2[_config][2], 10 ) ;
+        { MC_STAT( ++_stats.subcases13[MCStats::S13_5_2] )  add_triangle( tiling13_5_2[_config][2], 10 ) ; }
         break ;
       case 26 :/* 13.5 */
         _subconfig = 3 ;
         if( test_interior( test13[_config][6], cube ) )
-          add_triangle( tiling13_5_1[_config][3], 6 ) ;
+        { MC_STAT( ++_stats.subcases13[MCStats::S13_5_1] )  add_triangle( tiling13_5_1[_config][3], 6 ) ; }
         else
-          add_triangle( tiling13_5_2[_config][3], 10 ) ;
+        { MC_STAT( ++_stats.subcases13[MCStats::S13_5_2] )  add_triangle( tiling13_5_2[_config][3], 10 ) ; }
         break ;
 
       case 27 :/* 13.3 */
@@ -785,31 +1350,93 @@ real MarchingCubes::get_z_grad( const int i, const int j, const int k ) const
 //_____________________________________________________________________________
 
 
+//_____________________________________________________________________________
+// Normal from the analytic gradient
+glm::vec3 MarchingCubes::analytic_normal( const glm::vec3 &pos ) const
+//-----------------------------------------------------------------------------
+{
+	auto g = _gradient(pos);
+	auto l = glm::length(g);
+	return l > 0.f ? g / l : g;
+}
+//_____________________________________________________________________________
+
+
+//_____________________________________________________________________________
+// Grid to world map
+void MarchingCubes::set_transform( const glm::mat4 &m /*= glm::mat4( 1.0f )*/ )
+//-----------------------------------------------------------------------------
+{
+  _transform   = m ;
+  _inverse     = glm::inverse( m ) ;
+  _normal_map  = glm::transpose( glm::inverse( glm::mat3( m ) ) ) ;
+  _transformed = m != glm::mat4( 1.0f ) ;
+}
+//_____________________________________________________________________________
+
+
 //_____________________________________________________________________________
 // Adding vertices
 
 int MarchingCubes::add_vertex(const glm::ivec3 &grid_coord, const glm::ivec3 &dir, int corner, float *cube) {
 	auto u = cube[0] / (cube[0] - cube[corner]);
-	auto pos = glm::vec3(grid_coord) + glm::vec3(dir) * u;
+	auto pos = glm::vec3(grid_coord + _offset) + glm::vec3(dir) * u;
 	
+	add_key(grid_coord, dir);
+	if( _gradient ) {
+		auto n = world_normal(analytic_normal(pos));
+		pos = world_position(pos);
+		_vertices.push_back(Vertex{pos.x, pos.y, pos.z, n.x, n.y, n.z});
+		return _vertices.size() - 1;
+	}
+
 	auto grid_coord2 = grid_coord + dir;
 	auto nx = (1-u)*get_x_grad(grid_coord.x, grid_coord.y, grid_coord.z) + u * get_x_grad(grid_coord2.x, grid_coord2.y, grid_coord2.z);
 	auto ny = (1-u)*get_y_grad(grid_coord.x, grid_coord.y, grid_coord.z) + u * get_y_grad(grid_coord2.x, grid_coord2.y, grid_coord2.z);
 	auto nz = (1-u)*get_z_grad(grid_coord.x, grid_coord.y, grid_coord.z) + u * get_z_grad(grid_coord2.x, grid_coord2.y, grid_coord2.z);
 	
-	auto n = glm::normalize(glm::vec3(nx, ny, nz));
+	auto n = world_normal(glm::normalize(glm::vec3(nx, ny, nz)));
+	pos = world_position(pos);
 	_vertices.push_back(Vertex{pos.x, pos.y, pos.z, n.x, n.y, n.z});
 	return _vertices.size() - 1;
 }
 
+//_____________________________________________________________________________
+// vertices of the active cube computed on demand
+void MarchingCubes::add_cube_vertices( float *cube )
+//-----------------------------------------------------------------------------
+{
+  // first corner, last corner and axis of each edge, in the order of add_triangle
+  static const int edges[12][3] = { {0,1,0}, {1,2,1}, {3,2,0}, {0,3,1}, {4,5,0}, {5,6,1}, {7,6,0}, {4,7,1},
+                                    {0,4,2}, {1,5,2}, {2,6,2}, {3,7,2} } ;
+  for( int e = 0 ; e < 12 ; ++e )
+  {
+    const int p = edges[e][0], q = edges[e][1] ;
+    if( ( ( _lut_entry >> p ) & 1 ) == ( ( _lut_entry >> q ) & 1 ) ) continue ;
+
+    const glm::ivec3 g( _i+((p^(p>>1))&1), _j+((p>>1)&1), _k+((p>>2)&1) ) ;
+    glm::ivec3 dir( 0 ) ;
+    dir[ edges[e][2] ] = 1 ;
+    float ends[2] = { cube[p], cube[q] } ;
+    switch( edges[e][2] )
+    {
+    case 0 : if( get_x_vert( g.x, g.y, g.z ) == -1 ) set_x_vert( add_vertex( g, dir, 1, ends ), g.x, g.y, g.z ) ; break ;
+    case 1 : if( get_y_vert( g.x, g.y, g.z ) == -1 ) set_y_vert( add_vertex( g, dir, 1, ends ), g.x, g.y, g.z ) ; break ;
+    case 2 : if( get_z_vert( g.x, g.y, g.z ) == -1 ) set_z_vert( add_vertex( g, dir, 1, ends ), g.x, g.y, g.z ) ; break ;
+    }
+  }
+}
+//_____________________________________________________________________________
+
 int MarchingCubes::add_c_vertex()
 //-----------------------------------------------------------------------------
 {
+  MC_STAT( ++_stats.c_vertices )
   auto u = float{0.f};
 	auto pos = glm::vec3(0.f);
 	auto n = glm::vec3(0.f);
 
-  // Computes the average of the intersection points of the cube
+  // Computes the average of the intersection points of the cube, already in world coordinates
 	// x-face
 	for(auto t : {0, 1}) {
 		for(auto s : {0, 1}) {
@@ -850,7 +1477,8 @@ int MarchingCubes::add_c_vertex()
 	}
 	
 	pos *= 1.f/u;
-	n = glm::normalize(n);
+	n = _gradient ? world_normal(analytic_normal(grid_position(pos))) : glm::normalize(n);
+	if( _keyed ) _keys.push_back(-1);
 	_vertices.push_back(Vertex{pos.x, pos.y, pos.z, n.x, n.y, n.z});
   return _vertices.size() - 1;
 }
@@ -13,7 +13,14 @@
 #ifndef _MARCHINGCUBES_H_
 #define _MARCHINGCUBES_H_
 
+#include <stdint.h>
+#include <string.h>
 #include <vector>
+#include <functional>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include "memory_resource.h"
 
 //_____________________________________________________________________________
 // types
@@ -55,6 +62,91 @@ typedef struct
 {
   int v1,v2,v3 ;  /**< Triangle vertices */
 } Triangle ;
+
+//-----------------------------------------------------------------------------
+// Mesh structure
+/** \struct MCMesh "MarchingCubes.h" MarchingCubes
+ * Mesh owning its buffers, taken from a MarchingCubes by take_mesh without copy : it can be moved to a renderer, a
+ * writer or another thread while the MarchingCubes goes on with the next extraction
+ * \brief mesh structure
+ */
+struct MCMesh
+{
+  MCBuffer<Vertex>   vertices  ;  /**< vertex   buffer */
+  MCBuffer<Triangle> triangles ;  /**< triangle buffer */
+  MCBuffer<int64_t>  keys      ;  /**< grid edge of each vertex, when keyed */
+
+  /** number of vertices */
+  inline int nverts() const { return (int)vertices .size() ; }
+  /** number of triangles */
+  inline int ntrigs() const { return (int)triangles.size() ; }
+} ;
+
+//-----------------------------------------------------------------------------
+// Gradient callback
+/** Analytic gradient of the implicit function at a point given in grid coordinates, expressed in grid coordinates */
+typedef std::function< glm::vec3 ( const glm::vec3 &grid_pos ) > GradientFunction ;
+
+//-----------------------------------------------------------------------------
+// Sampling callback
+/** Evaluates the implicit function at the grid samples first + (i,j,k)*stride for 0 <= (i,j,k) < n, and stores them in res[ i + n.x*( j + n.y*k ) ] */
+typedef std::function< void ( const glm::ivec3 &first, const glm::ivec3 &stride, const glm::ivec3 &n, float *res ) > SampleFunction ;
+
+//-----------------------------------------------------------------------------
+// Range callback
+/** Bounds the values of the implicit function at the grid samples lo <= (i,j,k) <= hi */
+typedef std::function< void ( const glm::ivec3 &lo, const glm::ivec3 &hi, float &vmin, float &vmax ) > RangeFunction ;
+
+//-----------------------------------------------------------------------------
+// Statistics
+/** collects the statistics of run when defined to 1, otherwise the counters are compiled out */
+#ifndef MC_STATS
+#define MC_STATS 0
+#endif // MC_STATS
+
+#if MC_STATS
+#define MC_STAT( ... ) { __VA_ARGS__ ; }
+#else  // MC_STATS
+#define MC_STAT( ... ) {}
+#endif // MC_STATS
+
+/** \struct MCStats "MarchingCubes.h" MarchingCubes
+ * Phase timings and counters of the last run, null unless compiled with MC_STATS
+ * \brief statistics structure
+ */
+struct MCStats
+{
+  /** subconfigurations of the case 13 */
+  enum { S13_1, S13_2, S13_3, S13_4, S13_5_1, S13_5_2, N13 } ;
+
+  double   signs_secs        ;  /**< wall time of the classification of the samples */
+  double   intersection_secs ;  /**< wall time of the computation of the vertices on the edges */
+  double   tesselation_secs  ;  /**< wall time of the tesselation of the cubes */
+  uint64_t cubes             ;  /**< cubes tesselated */
+  uint64_t cases[15]         ;  /**< cubes of each case */
+  uint64_t subcases13[N13]   ;  /**< cubes of each subconfiguration of the case 13 */
+  uint64_t face_tests        ;  /**< ambiguous face tests */
+  uint64_t interior_tests    ;  /**< interior ambiguity tests */
+  uint64_t c_vertices        ;  /**< vertices added inside the cubes */
+  uint64_t vertices          ;  /**< vertices of the mesh */
+  uint64_t triangles         ;  /**< triangles of the mesh */
+  uint64_t bytes             ;  /**< bytes allocated for the grid, the temporary structures and the mesh */
+
+  MCStats() { clear() ; }
+  /** resets all the statistics */
+  inline void clear() { memset( (void*)this, 0, sizeof(MCStats) ) ; }
+  /** accumulates the statistics of another run */
+  inline MCStats &operator+=( const MCStats &s )
+  {
+    signs_secs += s.signs_secs ;  intersection_secs += s.intersection_secs ;  tesselation_secs += s.tesselation_secs ;
+    cubes += s.cubes ;
+    for( int c = 0 ; c < 15  ; ++c ) cases[c] += s.cases[c] ;
+    for( int c = 0 ; c < N13 ; ++c ) subcases13[c] += s.subcases13[c] ;
+    face_tests += s.face_tests ;  interior_tests += s.interior_tests ;  c_vertices += s.c_vertices ;
+    vertices += s.vertices ;  triangles += s.triangles ;  bytes += s.bytes ;
+    return *this ;
+  }
+} ;
 //_____________________________________________________________________________
 
 
@@ -67,6 +159,10 @@ typedef struct
 class MarchingCubes
 //-----------------------------------------------------------------------------
 {
+  friend class MeshPipeline ;
+  friend class BrickExtractor ;
+  friend class DistributedExtractor ;
+
 // Constructors
 public :
   /**
@@ -75,8 +171,9 @@ public :
    * \param size_x width  of the grid
    * \param size_y depth  of the grid
    * \param size_z height of the grid
+   * \param resource memory of the grid, of the temporary structures and of the mesh, the heap if null
    */
-  MarchingCubes ( const int size_x = -1, const int size_y = -1, const int size_z = -1 ) ;
+  MarchingCubes ( const int size_x = -1, const int size_y = -1, const int size_z = -1, MemoryResource *resource = NULL ) ;
 
 //-----------------------------------------------------------------------------
 // Accessors
@@ -94,6 +191,20 @@ public :
   inline Vertex   *vertices () { return _vertices.data()  ; }
   /** accesses the triangle buffer of the generated mesh */
   inline Triangle *triangles() { return _triangles.data() ; }
+  /** accesses the statistics of the last run, null unless compiled with MC_STATS */
+  inline const MCStats &stats() const { return _stats ; }
+
+  /** accesses the grid edge of each vertex of the generated mesh, when keyed by set_edge_keys */
+  inline const int64_t *keys() const { return _keys.data() ; }
+  /** accesses the memory resource of the buffers */
+  inline MemoryResource *resource() const { return _vertices.get_allocator().resource() ; }
+
+  /**
+   * hands the generated mesh over without copy, leaving this object without mesh : the next run reserves buffers of
+   * the size of the mesh taken
+   * \return the mesh, its buffers coming from the memory resource of this object
+   */
+  MCMesh take_mesh() ;
 
   /**  accesses the width  of the grid */
   inline const int size_x() const { return _size_x ; }
@@ -108,12 +219,53 @@ public :
    * \param size_y depth  of the grid
    * \param size_z height of the grid
    */
-  inline void set_resolution( const int size_x, const int size_y, const int size_z ) { _size_x = size_x ;  _size_y = size_y ;  _size_z = size_z ; }
+  inline void set_resolution( const int size_x, const int size_y, const int size_z )
+  { _size_x = size_x ;  _size_y = size_y ;  _size_z = size_z ;  set_region( glm::ivec3(0), glm::ivec3( size_x-1, size_y-1, size_z-1 ) ) ; }
+  /**
+   * restricts the tesselation to a part of the grid, the samples around it being only used for the normals
+   * (set_resolution resets the region to the whole grid)
+   * \param lo     first sample of the region
+   * \param hi     last sample of the region
+   * \param offset position of the first sample of the grid, added to the vertices
+   */
+  inline void set_region    ( const glm::ivec3 &lo, const glm::ivec3 &hi, const glm::ivec3 &offset = glm::ivec3(0) ) { _lo = lo ;  _hi = hi ;  _offset = offset ; }
   /**
    * selects wether the algorithm will use the enhanced topologically controlled lookup table or the original MarchingCubes
    * \param originalMC true for the original Marching Cubes
    */
   inline void set_method    ( const bool originalMC = false ) { _originalMC = originalMC ; }
+  /**
+   * sets an analytic gradient used for the vertex normals instead of the finite differences on the grid
+   * \param gradient gradient callback, evaluated at the final vertex positions, or nullptr to use the grid
+   */
+  inline void set_gradient  ( const GradientFunction &gradient = nullptr ) { _gradient = gradient ; }
+  /**
+   * sets the affine map from the grid coordinates to the world coordinates of the vertices of the following runs,
+   * the normals being mapped by its inverse transpose
+   * \param m affine map, the identity by default
+   */
+  void set_transform( const glm::mat4 &m = glm::mat4( 1.0f ) ) ;
+  /**
+   * sets the world position of the first sample and the spacing of the samples along each axis
+   * \param origin  position of the sample (0,0,0)
+   * \param spacing distance between two samples along each axis
+   */
+  inline void set_transform( const glm::vec3 &origin, const glm::vec3 &spacing )
+  {
+    glm::mat4 m( 1.0f ) ;
+    m[0][0] = spacing.x ;  m[1][1] = spacing.y ;  m[2][2] = spacing.z ;
+    m[3] = glm::vec4( origin, 1.0f ) ;
+    set_transform( m ) ;
+  }
+  /** accesses the map from the grid coordinates to the world coordinates */
+  inline const glm::mat4 &transform() const { return _transform ; }
+  /**
+   * keys each vertex of the following runs by its grid edge : voxel index * 3 + axis in the whole grid, or -1 for the
+   * vertices inside a cube. The meshes of different parts of a grid can then be welded by MeshMerger.
+   * \param keyed       true to record the keys
+   * \param global_size size of the whole grid, including the offset of set_region, the grid itself by default
+   */
+  inline void set_edge_keys ( const bool keyed = true, const glm::ivec3 &global_size = glm::ivec3(0) ) { _keyed = keyed ;  _global = global_size ; }
 
   // Data access
   /**
@@ -140,6 +292,36 @@ public :
   void init_temps () ;
   /** inits all structures (must set sizes before call) : the temporary structures and the mesh buffers */
   void init_all   () ;
+  /**
+   * clears the mesh and the vertex indices of the previous run, keeping the samples and the capacity of the buffers :
+   * another run on the same grid, for instance at another isovalue, then costs no allocation nor pass over the grid
+   */
+  void reset      () ;
+
+  /**
+   * fills the grid coarse to fine (must call init_temps before) : the function is first evaluated at the corners of
+   * the bricks, then inside the bricks that may cross the isosurface only. The other bricks are interpolated from
+   * their corners and skipped by run.
+   * \param f         sampling callback
+   * \param iso       isovalue given to run
+   * \param lipschitz bound on the variation of the function along one grid unit, 0 to trust the signs of the corners
+   * \param margin    distance to the isovalue that the corners of a skipped brick must exceed
+   * \param brick     edge of the bricks, in cubes
+   * \return number of skipped bricks
+   */
+  int sample_adaptive( const SampleFunction &f, real iso = (real)0.0, real lipschitz = (real)0.0, real margin = (real)0.0, int brick = 8 ) ;
+
+  /**
+   * fills the grid by bricks (must call init_temps before) : the function is evaluated only inside the bricks whose
+   * range contains the isovalue. The other bricks are filled with a value of their sign and skipped by run.
+   * \param f      sampling callback
+   * \param range  bounds of the function on a brick
+   * \param iso    isovalue given to run
+   * \param margin distance to the isovalue that the range of a skipped brick must exceed
+   * \param brick  edge of the bricks, in cubes
+   * \return number of skipped bricks
+   */
+  int sample_bounded( const SampleFunction &f, const RangeFunction &range, real iso = (real)0.0, real margin = (real)0.0, int brick = 8 ) ;
 
 
 //-----------------------------------------------------------------------------
@@ -151,12 +333,83 @@ public :
    */
   void run( real iso = (real)0.0 ) ;
 
+  /**
+   * Surface tracking : tesselates only the cubes reached from the seeds through faces crossed by the isosurface,
+   * their vertices being computed on demand, so that the cost follows the size of the surface rather than of the
+   * grid. Must be called after init_all, gives the mesh of run for the components of the isosurface that are seeded.
+   * \param iso    isovalue
+   * \param seeds  cubes to start from, or empty to search the isosurface along lines of samples spaced by stride
+   * \param stride spacing of the search lines : the components of the isosurface that cross none are missed
+   * \return number of cubes tesselated
+   */
+  int run_seeded( real iso = (real)0.0, const std::vector<glm::ivec3> &seeds = std::vector<glm::ivec3>(), int stride = 8 ) ;
+
+//-----------------------------------------------------------------------------
+// Exportation
+public :
+  /**
+   * binary PLY exportation of the generated mesh
+   * \param fn name of the PLY file to create
+   * \return false if the file could not be written
+   */
+  bool writePLY( const char *fn ) const ;
+  /**
+   * binary STL exportation of the generated mesh
+   * \param fn name of the STL file to create
+   * \return false if the file could not be written
+   */
+  bool writeSTL( const char *fn ) const ;
+  /**
+   * PLY importation of a mesh, replacing the generated one
+   * \param fn name of the PLY file to read
+   * \return false if the file could not be read
+   */
+  bool readPLY( const char *fn ) ;
+  /**
+   * bricked ISO exportation of the grid
+   * \param fn     name of the ISO file to create
+   * \param bounds extent of the grid : xmin, xmax, ymin, ymax, zmin, zmax, [-1,1]^3 by default
+   * \param brick  edge of the bricks in samples
+   * \param iso    isovalue subtracted from the samples of the grid, added back to write the field itself
+   * \return false if the file could not be written
+   */
+  bool writeISO( const char *fn, const float bounds[6] = NULL, int brick = 32, real iso = (real)0.0 ) const ;
+
 protected :
+  /** loads the values of the active cube relative to the isovalue, away from 0, and its sign representation */
+  inline void load_cube( float *cube, real iso )
+  {
+    _lut_entry = 0 ;
+    for( int p = 0 ; p < 8 ; ++p )
+    {
+      cube[p] = get_data( glm::ivec3( _i+((p^(p>>1))&1), _j+((p>>1)&1), _k+((p>>2)&1) ) ) - iso ;
+      if( std::abs( cube[p] ) < std::numeric_limits<float>::epsilon() ) cube[p] = std::numeric_limits<float>::epsilon() ;
+      if( cube[p] > 0 ) _lut_entry += 1 << p ;
+    }
+  }
   /** tesselates one cube */
   void process_cube (float *cube);
+  /** tests if the components of the tesselation of the cube should be connected through an ambiguous face */
+  bool test_face    ( schar face, float *cube ) ;
   /** tests if the components of the tesselation of the cube should be connected through the interior of the cube */
   bool test_interior( schar s, float *cube )    ;
 
+  /** edge of the bricks traversed by run, in cubes */
+  inline int  brick_edge() const { return _skip.empty() ? std::max( _size_x, std::max( _size_y, _size_z ) ) : _brick ; }
+  /** number of bricks of a given edge along an axis of the given size */
+  static inline int brick_count( const int size, const int edge ) { return size < 2 ? 1 : ( size - 2 ) / edge + 1 ; }
+  /** completes the counters of the statistics at the end of a run */
+  void finish_stats() ;
+  /** sizes the vertex indices to the grid, all unset, clearing only the ones set since the last reset */
+  void clear_edges() ;
+  /** clears the mesh buffers, reserving the size of the last mesh */
+  void clear_mesh() ;
+  /** evaluates the bricks that are not skipped, the far faces being left to the next brick when it is evaluated too */
+  void sample_bricks( const SampleFunction &f, const std::vector<uchar> &skip ) ;
+  /** tells if a brick has been found of constant sign by sample_adaptive */
+  inline bool brick_skipped( const int bi, const int bj, const int bk ) const
+  { return !_skip.empty() && _skip[ bi + _bricks.x * ( bj + _bricks.y * bk ) ] ; }
+
 
 //-----------------------------------------------------------------------------
 // Operations
@@ -167,6 +420,21 @@ protected :
    */
   void compute_intersection_points( real iso ) ;
 
+  /**
+   * classifies the samples against the isovalue, once per run : one bit per sample, set when the sample is positive
+   * once moved away from the isovalue, by rows of words along x
+   * \param iso isovalue
+   */
+  void compute_signs( real iso ) ;
+
+  /**
+   * tesselates the cubes of the region whose corners change sign, after compute_signs and compute_intersection_points
+   * \param iso isovalue
+   */
+  void tesselate( real iso ) ;
+  /** accesses the sign words of a row of samples */
+  inline const uint64_t *sign_row( const int j, const int k ) const { return _signs.data() + ( j + (size_t)_size_y * k ) * _sign_words ; }
+
   /**
    * routine to add a triangle to the mesh
    * \param trig the code for the triangle as a sequence of edges index
@@ -176,8 +444,34 @@ protected :
   void add_triangle ( const char* trig, char n, int v12 = -1 ) ;
 
   int add_vertex(const glm::ivec3 &grid_coord, const glm::ivec3 &dir, int corner, float *cube);
+  /** adds the missing vertices on the edges of the active cube crossed by the isosurface, for run_seeded */
+  void add_cube_vertices( float *cube ) ;
   /** adds a vertex inside the current cube */
   int add_c_vertex() ;
+  /** records the key of the vertex just added on an edge */
+  inline void add_key( const glm::ivec3 &grid_coord, const glm::ivec3 &dir )
+  {
+    if( !_keyed ) return ;
+    const glm::ivec3 g = grid_coord + _offset ;
+    const int64_t gx = _global.x > 0 ? _global.x : _size_x, gy = _global.y > 0 ? _global.y : _size_y ;
+    _keys.push_back( 3 * ( g.x + gx * ( g.y + gy * g.z ) ) + ( dir.y ? 1 : dir.z ? 2 : 0 ) ) ;
+  }
+  /** normalized analytic gradient at a point in grid coordinates */
+  glm::vec3 analytic_normal( const glm::vec3 &pos ) const ;
+  /** world position of a point in grid coordinates */
+  inline glm::vec3 world_position( const glm::vec3 &pos ) const
+  { return _transformed ? glm::vec3( _transform * glm::vec4( pos, 1.0f ) ) : pos ; }
+  /** grid coordinates of a world position */
+  inline glm::vec3 grid_position( const glm::vec3 &pos ) const
+  { return _transformed ? glm::vec3( _inverse * glm::vec4( pos, 1.0f ) ) : pos ; }
+  /** unit world normal of a normal in grid coordinates */
+  inline glm::vec3 world_normal( const glm::vec3 &n ) const
+  {
+    if( !_transformed ) return n ;
+    const glm::vec3 w = _normal_map * n ;
+    const float     l = glm::length( w ) ;
+    return l > 0.f ? w / l : w ;
+  }
 
   /**
    * interpolates the horizontal gradient of the implicit function at the lower vertex of the specified cube
@@ -230,7 +524,8 @@ protected :
    * \param j ordinate of the cube
    * \param k height of the cube
    */
-  inline void  set_x_vert( const int val, const int i, const int j, const int k ) { _x_verts[ i + j*_size_x + k*_size_x*_size_y] = val ; }
+  inline void  set_x_vert( const int val, const int i, const int j, const int k )
+  { const size_t c = i + j*_size_x + (size_t)k*_size_x*_size_y ;  _x_verts[c] = val ;  _touched.push_back( 3*c   ) ; }
   /**
    * sets the pre-computed vertex index on the lower longitudinal edge of a specific cube
    * \param val the index of the new vertex
@@ -238,7 +533,8 @@ protected :
    * \param j ordinate of the cube
    * \param k height of the cube
    */
-  inline void  set_y_vert( const int val, const int i, const int j, const int k ) { _y_verts[ i + j*_size_x + k*_size_x*_size_y] = val ; }
+  inline void  set_y_vert( const int val, const int i, const int j, const int k )
+  { const size_t c = i + j*_size_x + (size_t)k*_size_x*_size_y ;  _y_verts[c] = val ;  _touched.push_back( 3*c+1 ) ; }
   /**
    * sets the pre-computed vertex index on the lower vertical edge of a specific cube
    * \param val the index of the new vertex
@@ -246,24 +542,44 @@ protected :
    * \param j ordinate of the cube
    * \param k height of the cube
    */
-  inline void  set_z_vert( const int val, const int i, const int j, const int k ) { _z_verts[ i + j*_size_x + k*_size_x*_size_y] = val ; }
+  inline void  set_z_vert( const int val, const int i, const int j, const int k )
+  { const size_t c = i + j*_size_x + (size_t)k*_size_x*_size_y ;  _z_verts[c] = val ;  _touched.push_back( 3*c+2 ) ; }
 
 //-----------------------------------------------------------------------------
 // Elements
 protected :
   bool      _originalMC ;   /**< selects wether the algorithm will use the enhanced topologically controlled lookup table or the original MarchingCubes */
+  GradientFunction _gradient ; /**< analytic gradient for the normals, if any */
+  glm::mat4 _transform  ;  /**< map from the grid coordinates to the world coordinates */
+  glm::mat4 _inverse    ;  /**< map from the world coordinates to the grid coordinates */
+  glm::mat3 _normal_map ;  /**< inverse transpose of the linear part of the transform, for the normals */
+  bool      _transformed;  /**< false for the identity transform */
 
   int       _size_x     ;  /**< width  of the grid */
   int       _size_y     ;  /**< depth  of the grid */
   int       _size_z     ;  /**< height of the grid */
-  std::vector<float> _data;
-
-	std::vector<int> _x_verts    ;  /**< pre-computed vertex indices on the lower horizontal   edge of each cube */
-	std::vector<int> _y_verts    ;  /**< pre-computed vertex indices on the lower longitudinal edge of each cube */
-	std::vector<int> _z_verts    ;  /**< pre-computed vertex indices on the lower vertical     edge of each cube */
-
-  std::vector<Vertex> _vertices   ;  /**< vertex   buffer */
-	std::vector<Triangle> _triangles  ;  /**< triangle buffer */
+  MCBuffer<float> _data;
+  int       _brick      ;  /**< edge of the bricks of sample_adaptive or sample_bounded, in cubes */
+  glm::ivec3 _bricks    ;  /**< number of bricks of sample_adaptive or sample_bounded along each axis */
+  glm::ivec3 _lo        ;  /**< first sample of the tesselated region */
+  glm::ivec3 _hi        ;  /**< last sample of the tesselated region */
+  glm::ivec3 _offset    ;  /**< position of the first sample of the grid */
+  bool      _keyed      ;  /**< records the grid edges of the vertices */
+  glm::ivec3 _global    ;  /**< size of the whole grid for the keys, the grid itself if null */
+  std::vector<uchar> _skip ;  /**< bricks of constant sign skipped by run, empty to process the whole grid */
+  MCBuffer<uint64_t> _signs ;  /**< sign of each sample, by rows of words along x */
+  int       _sign_words ;  /**< number of sign words of a row */
+
+	MCBuffer<int> _x_verts    ;  /**< pre-computed vertex indices on the lower horizontal   edge of each cube */
+	MCBuffer<int> _y_verts    ;  /**< pre-computed vertex indices on the lower longitudinal edge of each cube */
+	MCBuffer<int> _z_verts    ;  /**< pre-computed vertex indices on the lower vertical     edge of each cube */
+  MCBuffer<size_t> _touched ;  /**< vertex indices set since the last reset, as 3 times the cube plus the axis */
+
+  MCBuffer<Vertex> _vertices   ;  /**< vertex   buffer */
+	MCBuffer<Triangle> _triangles  ;  /**< triangle buffer */
+  MCBuffer<int64_t>  _keys       ;  /**< grid edge of each vertex, when keyed */
+  size_t    _nverts_hint;  /**< vertices of the last mesh, reserved for the next run */
+  size_t    _ntrigs_hint;  /**< triangles of the last mesh, reserved for the next run */
 
   int       _i          ;  /**< abscisse of the active cube */
   int       _j          ;  /**< height of the active cube */
@@ -273,6 +589,8 @@ protected :
   uchar     _case       ;  /**< case of the active cube in [0..15] */
   uchar     _config     ;  /**< configuration of the active cube */
   uchar     _subconfig  ;  /**< subconfiguration of the active cube */
+
+  MCStats   _stats      ;  /**< statistics of the last run */
 };
 //_____________________________________________________________________________
 
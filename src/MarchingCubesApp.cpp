@@ -53,22 +53,17 @@ void MarchingCubesApp::setup()
 
 	run();
 
-	auto verts = std::vector<glm::vec3>();
-	verts.reserve(mc.ntrigs() * 3);
+	// the mesh is uploaded as extracted, the vertices interleaving their position and normal and the triangles
+	// giving the indices
+	const MCMesh m = mc.take_mesh();
+	geom::BufferLayout layout;
+	layout.append(geom::POSITION, 3, sizeof(Vertex), offsetof(Vertex, x));
+	layout.append(geom::NORMAL, 3, sizeof(Vertex), offsetof(Vertex, nx));
+	auto vbo = gl::Vbo::create(GL_ARRAY_BUFFER, m.vertices.size() * sizeof(Vertex), m.vertices.data());
+	auto ibo = gl::Vbo::create(GL_ELEMENT_ARRAY_BUFFER, m.triangles.size() * sizeof(Triangle), m.triangles.data());
+	std::vector<std::pair<geom::BufferLayout, gl::VboRef>> buffers = { std::make_pair(layout, vbo) };
 
-	for( int i = 0 ; i < mc.ntrigs() ; ++i ) {
-		const Triangle *t = mc.trig(i) ;
-		const Vertex   *v ;
-		v = mc.vert(t->v1) ;
-		verts.push_back(glm::vec3(v->x, v->y, v->z));
-		v = mc.vert(t->v2) ;
-		verts.push_back(glm::vec3(v->x, v->y, v->z));
-		v = mc.vert(t->v3) ;
-		verts.push_back(glm::vec3(v->x, v->y, v->z));
-	}
-	
-	auto mesh = gl::VboMesh::create(verts.size(), GL_LINES, {gl::VboMesh::Layout().attrib(geom::POSITION, 3)});
-	mesh->bufferAttrib(geom::POSITION, verts);
+	auto mesh = gl::VboMesh::create(m.nverts(), GL_LINES, buffers, 3 * m.ntrigs(), GL_UNSIGNED_INT, ibo);
 	auto shader = LoadShader("pass", false);
 	batches.push_back(gl::Batch::create(mesh, shader));
 }
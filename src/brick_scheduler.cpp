@@ -0,0 +1,209 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// Brick scheduler
+// Parallel extraction by bricks with work stealing
+//
+//________________________________________________
+
+
+#include <thread>
+#include <numeric>
+#include <algorithm>
+#include "brick_scheduler.h"
+#include "mesh_merge.h"
+#include "trace.h"
+
+
+//_____________________________________________________________________________
+// Constructor
+BrickScheduler::BrickScheduler( int nthreads ) :
+//-----------------------------------------------------------------------------
+  _deques( nthreads > 0 ? nthreads : std::max( 1u, std::thread::hardware_concurrency() ) )
+{
+  _executed.assign( _deques.size(), 0 ) ;
+  _stolen  .assign( _deques.size(), 0 ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// takes the next task of a worker
+bool BrickScheduler::next( int w, int &task )
+//-----------------------------------------------------------------------------
+{
+  // own tasks, most expensive first
+  {
+    std::lock_guard<std::mutex> guard( _deques[w].lock ) ;
+    std::deque<int> &q = _deques[w].tasks ;
+    if( !q.empty() ) { task = q.front() ;  q.pop_front() ;  return true ; }
+  }
+
+  // cheapest task of another worker
+  const int n = nthreads() ;
+  for( int d = 1 ; d < n ; ++d )
+  {
+    Deque &victim = _deques[ (w + d) % n ] ;
+    std::lock_guard<std::mutex> guard( victim.lock ) ;
+    if( victim.tasks.empty() ) continue ;
+    task = victim.tasks.back() ;
+    victim.tasks.pop_back() ;
+    ++_stolen[w] ;
+    return true ;
+  }
+  return false ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// runs the tasks
+void BrickScheduler::run( const std::vector<float> &cost, const Task &task )
+//-----------------------------------------------------------------------------
+{
+  const int n = nthreads() ;
+  std::fill( _executed.begin(), _executed.end(), 0 ) ;
+  std::fill( _stolen  .begin(), _stolen  .end(), 0 ) ;
+
+  // deals the tasks by decreasing cost
+  std::vector<int> order( cost.size() ) ;
+  std::iota( order.begin(), order.end(), 0 ) ;
+  std::stable_sort( order.begin(), order.end(), [&]( int a, int b ) { return cost[a] > cost[b] ; } ) ;
+  int t = 0 ;
+  for( int o : order )
+    if( cost[o] > 0 ) _deques[ t++ % n ].tasks.push_back( o ) ;
+
+  // no task is added once the workers are started : a worker finding all the deques empty is done
+  auto work = [&]( int w )
+  {
+    for( int k ; next( w, k ) ; ++_executed[w] ) task( w, k ) ;
+  } ;
+  std::vector<std::thread> threads ;
+  for( int w = 1 ; w < n ; ++w ) threads.push_back( std::thread( work, w ) ) ;
+  work( 0 ) ;
+  for( std::thread &th : threads ) th.join() ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// tesselates the grid of mc by bricks
+int BrickExtractor::run( MarchingCubes &mc, real iso, const RangeFunction &range )
+//-----------------------------------------------------------------------------
+{
+  const glm::ivec3 size( mc.size_x(), mc.size_y(), mc.size_z() ) ;
+  const int B = mc._skip.empty() ? _brick : mc._brick ;
+  const glm::ivec3 nb( MarchingCubes::brick_count( size.x, B ), MarchingCubes::brick_count( size.y, B ), MarchingCubes::brick_count( size.z, B ) ) ;
+  const int nbricks = nb.x * nb.y * nb.z ;
+
+  // cost of the bricks : the sign changes along every fourth row of samples in y and z, estimating the cubes crossed by
+  // the isosurface, over a base for the scan of their cubes, or nothing when they cannot cross the isosurface
+  const int   S   = 4 ;
+  const float eps = std::numeric_limits<float>::epsilon() ;
+  std::vector<float> cost( nbricks ) ;
+  for( int bk = 0, b = 0 ; bk < nb.z ; ++bk )
+  for( int bj = 0 ; bj < nb.y ; ++bj )
+  for( int bi = 0 ; bi < nb.x ; ++bi, ++b )
+  {
+    const glm::ivec3 lo = glm::ivec3( bi, bj, bk ) * B ;
+    const glm::ivec3 hi = glm::min( lo + B, size - 1 ) ;
+    if( mc.brick_skipped( bi, bj, bk ) ) continue ;
+    if( range )
+    {
+      // same sign convention as run
+      float vmin, vmax ;
+      range( lo, hi, vmin, vmax ) ;
+      if( vmin - iso > 0 || vmax - iso <= -eps ) continue ;
+    }
+    int changes = 0 ;
+    for( int k = lo.z ; k <= hi.z ; k += S )
+    for( int j = lo.y ; j <= hi.y ; j += S )
+    {
+      bool neg = mc.get_data( glm::ivec3( lo.x, j, k ) ) - iso <= -eps ;
+      for( int i = lo.x + 1 ; i <= hi.x ; ++i )
+      {
+        const bool n = mc.get_data( glm::ivec3( i, j, k ) ) - iso <= -eps ;
+        changes += n != neg ;
+        neg = n ;
+      }
+    }
+    const glm::ivec3 d = glm::max( hi - lo, glm::ivec3( 1 ) ) ;
+    cost[b] = (float)d.x * d.y * d.z / 64 + (float)changes * S * S ;
+  }
+
+  // extraction of each brick with one ghost layer around it, the meshes of a worker coming from its own arena, released
+  // in one shot once merged
+  std::vector<MonotonicArena> arenas( _scheduler.nthreads() ) ;
+  std::vector<Piece> pieces( nbricks ) ;
+  std::vector<MarchingCubes> workers( _scheduler.nthreads() ) ;
+  std::vector<MCStats>       stats  ( _scheduler.nthreads() ) ;
+  _scheduler.run( cost, [&]( int w, int b )
+  {
+    MC_TRACE_SPAN( "brick" ) ;
+    const glm::ivec3 bc( b % nb.x, ( b / nb.x ) % nb.y, b / ( nb.x * nb.y ) ) ;
+    const glm::ivec3 lo = bc * B ;
+    const glm::ivec3 hi = glm::min( lo + B, size - 1 ) ;
+    const glm::ivec3 glo = glm::max( lo - 1, glm::ivec3( 0 ) ) ;
+    const glm::ivec3 ghi = glm::min( hi + 1, size - 1 ) ;
+    const glm::ivec3 n   = ghi - glo + 1 ;
+
+    MarchingCubes &wmc = workers[w] ;
+    wmc.set_method( mc._originalMC ) ;
+    wmc.set_resolution( n.x, n.y, n.z ) ;
+    wmc.set_region( lo - glo, hi - glo, glo ) ;
+    wmc.set_edge_keys( true, size ) ;
+    wmc.set_transform( mc._transform ) ;
+    wmc.init_all() ;
+    for( int k = 0 ; k < n.z ; ++k )
+    for( int j = 0 ; j < n.y ; ++j )
+    for( int i = 0 ; i < n.x ; ++i )
+      wmc.set_data( mc.get_data( glo + glm::ivec3( i, j, k ) ), i,j,k ) ;
+    wmc.run( iso ) ;
+    MC_STAT( stats[w] += wmc._stats )
+
+    Piece &p = pieces[b] ;
+    p.verts = MCBuffer<Vertex  >( wmc._vertices .begin(), wmc._vertices .end(), &arenas[w] ) ;
+    p.trigs = MCBuffer<Triangle>( wmc._triangles.begin(), wmc._triangles.end(), &arenas[w] ) ;
+    p.keys  = MCBuffer<int64_t >( wmc._keys     .begin(), wmc._keys     .end(), &arenas[w] ) ;
+  } ) ;
+
+  // welds the bricks in their order, into the memory of mc
+  MeshMerger merger( mc.resource() ) ;
+  int ntasks = 0 ;
+  for( int b = 0 ; b < nbricks ; ++b )
+  {
+    MC_TRACE_SPAN( "merge brick" ) ;
+    Piece &p = pieces[b] ;
+    if( cost[b] > 0 ) ++ntasks ;
+    merger.add( p.verts.data(), p.keys.data(), p.verts.size(), p.trigs.data(), p.trigs.size() ) ;
+    p = Piece() ;
+  }
+  mc._vertices .swap( merger.vertices () ) ;
+  mc._triangles.swap( merger.triangles() ) ;
+  if( mc._keyed ) mc._keys.swap( merger.keys() ) ;
+  else            mc._keys.clear() ;
+
+  // counters of all the bricks, the timings being summed over the workers
+#if MC_STATS
+  mc._stats.clear() ;
+  for( const MCStats &s : stats ) mc._stats += s ;
+  mc.finish_stats() ;
+#endif // MC_STATS
+
+  // the analytic gradient is not assumed thread safe
+  if( mc._gradient )
+  {
+    for( Vertex &v : mc._vertices )
+    {
+      const glm::vec3 n = mc.world_normal( mc.analytic_normal( mc.grid_position( glm::vec3( v.x, v.y, v.z ) ) ) ) ;
+      v.nx = n.x ;  v.ny = n.y ;  v.nz = n.z ;
+    }
+  }
+
+  return ntasks ;
+}
+//_____________________________________________________________________________
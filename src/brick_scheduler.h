@@ -0,0 +1,124 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// Brick scheduler
+// Parallel extraction by bricks with work stealing
+//
+//________________________________________________
+
+
+#ifndef _BRICK_SCHEDULER_H_
+#define _BRICK_SCHEDULER_H_
+
+#include <stdint.h>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include "MarchingCubes.h"
+
+//_____________________________________________________________________________
+// Work stealing scheduler
+/** \class BrickScheduler
+  * \brief Runs a fixed set of tasks on a pool of threads. The tasks are dealt by decreasing cost to one deque per
+  * worker : each worker runs its own tasks from the most expensive one, and steals the cheapest tasks of the other
+  * workers once its deque is empty.
+  */
+class BrickScheduler
+//-----------------------------------------------------------------------------
+{
+//-----------------------------------------------------------------------------
+// Constructors
+public :
+  /** task callback, receiving the index of the worker and of the task */
+  typedef std::function< void ( int worker, int task ) > Task ;
+
+  /** scheduler of nthreads workers, the number of hardware threads by default */
+  BrickScheduler( int nthreads = 0 ) ;
+
+//-----------------------------------------------------------------------------
+// Operations
+public :
+  /**
+   * runs the tasks 0 <= task < cost.size() and waits for their completion
+   * \param cost estimated cost of each task, the tasks of null cost are not run
+   * \param task callback running one task, from any worker
+   */
+  void run( const std::vector<float> &cost, const Task &task ) ;
+
+  /** number of workers */
+  inline int nthreads() const { return (int)_deques.size() ; }
+  /** number of tasks run by a worker during the last run */
+  inline int executed( int w ) const { return _executed[w] ; }
+  /** number of tasks stolen by a worker during the last run */
+  inline int stolen  ( int w ) const { return _stolen[w] ; }
+
+private :
+  /** pending tasks of a worker */
+  struct Deque { std::mutex lock ; std::deque<int> tasks ; } ;
+
+  /** takes the next task of worker w, from its own deque or from another one, false when all the deques are empty */
+  bool next( int w, int &task ) ;
+
+//-----------------------------------------------------------------------------
+// Elements
+private :
+  std::vector<Deque> _deques   ;  /**< pending tasks per worker */
+  std::vector<int>   _executed ;  /**< tasks run per worker */
+  std::vector<int>   _stolen   ;  /**< tasks stolen per worker */
+};
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// Parallel brick extractor
+/** \class BrickExtractor
+  * \brief Tesselates the grid of a MarchingCubes by bricks on the threads of a BrickScheduler. Each brick is extracted
+  * by a MarchingCubes of the worker, from a copy of its samples with one ghost layer for the normals, and the meshes
+  * of the bricks are welded on their shared edges in the order of the bricks : the result does not depend on the
+  * scheduling and has the vertices and triangles of MarchingCubes::run.
+  */
+class BrickExtractor
+//-----------------------------------------------------------------------------
+{
+//-----------------------------------------------------------------------------
+// Constructors
+public :
+  /**
+   * \param nthreads number of workers, the number of hardware threads by default
+   * \param brick    edge of the bricks, in cubes, when the grid has no brick from sample_adaptive
+   */
+  BrickExtractor( int nthreads = 0, int brick = 32 ) : _scheduler( nthreads ), _brick( std::max( brick, 1 ) ) {}
+
+//-----------------------------------------------------------------------------
+// Operations
+public :
+  /**
+   * replaces the mesh of mc by the tesselation of its grid
+   * \param mc    grid to tesselate, with its method and gradient
+   * \param iso   isovalue
+   * \param range bounds of the samples of a brick, called from the calling thread, to skip the bricks away from the
+   *              isovalue : the others are ordered by the sign changes along a sparse lattice of their rows
+   * \return number of bricks tesselated
+   */
+  int run( MarchingCubes &mc, real iso = (real)0.0, const RangeFunction &range = nullptr ) ;
+
+  /** scheduler of the last run */
+  inline const BrickScheduler &scheduler() const { return _scheduler ; }
+
+private :
+  /** mesh of a brick, with the key of each vertex, in the arena of its worker */
+  struct Piece { MCBuffer<Vertex> verts ; MCBuffer<Triangle> trigs ; MCBuffer<int64_t> keys ; } ;
+
+//-----------------------------------------------------------------------------
+// Elements
+private :
+  BrickScheduler _scheduler ;  /**< workers */
+  int            _brick     ;  /**< edge of the bricks */
+};
+//_____________________________________________________________________________
+
+
+#endif // _BRICK_SCHEDULER_H_
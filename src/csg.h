@@ -217,6 +217,8 @@ public :
 //-----------------------------------------------------------------------------
 // Elements
 private :
+  friend class CSG_Program ;
+
   Operation op   ;
   Primitive prim ;
   float     min[3], med[3], max[3] ;
@@ -0,0 +1,667 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// CSG program
+// Flattened CSG tree evaluated by batches of points
+//
+//________________________________________________
+
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include "csg_program.h"
+
+//_____________________________________________________________________________
+// The inner loops below run over a whole batch without branches or calls,
+// so that the compiler vectorizes them for the target instruction set.
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// flattens a parsed tree
+void CSG_Program::compile( const CSG_Node *root )
+//-----------------------------------------------------------------------------
+{
+  _code.clear() ;
+  _prim.clear() ;
+  for( int a = X ; a <= Z ; ++a ) { _med[a].clear() ; _min[a].clear() ; _max[a].clear() ; }
+  _r.clear() ;  _R.clear() ;  _axe.clear() ;
+  _depth = _height = 0 ;
+
+  if( root ) compile_node( root ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// appends the postfix code of a subtree
+void CSG_Program::compile_node( const CSG_Node *node )
+//-----------------------------------------------------------------------------
+{
+  if( ((node->prim == none) && (node->op == None)) || ((node->prim != none) && (node->op != None)) ||
+      ((node->op != None) && (!node->left || !node->right)) )
+  {
+    // evaluates to 0, as CSG_Node::eval does
+    printf( "CSG_Program::compile warning : inconsistent node\n" ) ;
+    CSG_Node zero ;
+    _code.push_back( add_primitive( &zero ) ) ;
+  }
+  else if( node->op == None )
+    _code.push_back( add_primitive( node ) ) ;
+  else
+  {
+    compile_node( node->left  ) ;
+    compile_node( node->right ) ;
+    _code.push_back( -(int)node->op ) ;
+    --_height ;
+    return ;
+  }
+
+  if( ++_height > _depth ) _depth = _height ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// adds a primitive to the table
+int CSG_Program::add_primitive( const CSG_Node *node )
+//-----------------------------------------------------------------------------
+{
+  _prim.push_back( node->prim ) ;
+  for( int a = X ; a <= Z ; ++a )
+  {
+    _med[a].push_back( node->med[a] ) ;
+    _min[a].push_back( node->min[a] ) ;
+    _max[a].push_back( node->max[a] ) ;
+  }
+  _r.push_back( node->r ) ;
+  _R.push_back( node->R ) ;
+  _axe.push_back( node->axe == X ? X : node->axe == Y ? Y : node->axe == Z ? Z : -1 ) ;
+  return (int)_prim.size() - 1 ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// evaluates the program at n points
+void CSG_Program::eval( const float *x, const float *y, const float *z, float *res, int n ) const
+//-----------------------------------------------------------------------------
+{
+  if( empty() ) { memset( res, 0, n * sizeof(float) ) ; return ; }
+  eval_code( _code, x, y, z, res, n ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// evaluates code at n points
+void CSG_Program::eval_code( const std::vector<int> &code, const float *x, const float *y, const float *z, float *res, int n ) const
+//-----------------------------------------------------------------------------
+{
+  std::vector<float> stack( _depth * BATCH ) ;
+  int b = 0 ;
+  for( ; b + BATCH <= n ; b += BATCH )
+  {
+    eval_batch( code, x+b, y+b, z+b, stack.data() ) ;
+    memcpy( res+b, stack.data(), BATCH * sizeof(float) ) ;
+  }
+
+  if( b < n )
+  {
+    // pads the last batch with its last point
+    float bx[BATCH], by[BATCH], bz[BATCH] ;
+    for( int q = 0 ; q < BATCH ; ++q )
+    {
+      int s = ( b+q < n ) ? b+q : n-1 ;
+      bx[q] = x[s] ;  by[q] = y[s] ;  bz[q] = z[s] ;
+    }
+    eval_batch( code, bx, by, bz, stack.data() ) ;
+    memcpy( res+b, stack.data(), (n-b) * sizeof(float) ) ;
+  }
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// evaluates one full batch
+void CSG_Program::eval_batch( const std::vector<int> &code, const float *x, const float *y, const float *z, float *stack ) const
+//-----------------------------------------------------------------------------
+{
+  float *top = stack - BATCH ;
+  for( size_t ip = 0 ; ip < code.size() ; ++ip )
+  {
+    const int c = code[ip] ;
+    if( c >= 0 )
+    {
+      top += BATCH ;
+      eval_primitive( c, x, y, z, top ) ;
+      continue ;
+    }
+
+    if( c == -Neg )
+    {
+      for( int q = 0 ; q < BATCH ; ++q ) top[q] = -top[q] ;
+      continue ;
+    }
+
+    float *a = top - BATCH, *b = top ;
+    switch( -c )
+    {
+    case Union : for( int q = 0 ; q < BATCH ; ++q ) a[q] = ( a[q] <  b[q] ) ? a[q] :  b[q] ; break ;
+    case Inter : for( int q = 0 ; q < BATCH ; ++q ) a[q] = ( a[q] >  b[q] ) ? a[q] :  b[q] ; break ;
+    case Diff  : for( int q = 0 ; q < BATCH ; ++q ) a[q] = ( a[q] > -b[q] ) ? a[q] : -b[q] ; break ;
+    default : break ;
+    }
+    for( int q = 0 ; q < BATCH ; ++q ) a[q] = ( a[q] == a[q] ) ? a[q] : 0.0f ;  // invalid calculus
+    top = a ;
+  }
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// evaluates primitive p on a batch
+void CSG_Program::eval_primitive( int p, const float *x, const float *y, const float *z, float *res ) const
+//-----------------------------------------------------------------------------
+{
+  const float mx = _med[X][p], my = _med[Y][p], mz = _med[Z][p] ;
+  const float r  = _r[p], R = _R[p] ;
+
+  switch( _prim[p] )
+  {
+  case sphere:
+    for( int q = 0 ; q < BATCH ; ++q )
+      res[q] = (x[q]-mx)*(x[q]-mx) + (y[q]-my)*(y[q]-my) + (z[q]-mz)*(z[q]-mz) - r*r ;
+    break ;
+
+  case heart:
+    for( int q = 0 ; q < BATCH ; ++q )
+    {
+      const float h = 2*x[q]*x[q] + y[q]*y[q] + z[q]*z[q] - 1 ;
+      res[q] = h*h*h - (1/10)*x[q]*x[q]*z[q]*z[q]*z[q] - y[q]*y[q]*z[q]*z[q]*z[q] ;
+    }
+    break ;
+
+  case tangle:
+    for( int q = 0 ; q < BATCH ; ++q )
+      res[q] = x[q]*x[q]*x[q]*x[q] - 5*x[q]*x[q] + y[q]*y[q]*y[q]*y[q] - 5*y[q]*y[q] + z[q]*z[q]*z[q]*z[q] - 5*z[q]*z[q] + 11.8f ;
+    break ;
+
+  case torus:
+    {
+      static const float zero[BATCH] = { 0 } ;
+      const float *i = zero, *j = zero, *k = zero ;
+      switch( _axe[p] )
+      {
+      case X : i = x ; j = y ; k = z ; break ;
+      case Y : i = y ; j = z ; k = x ; break ;
+      case Z : i = z ; j = x ; k = y ; break ;
+      }
+      for( int q = 0 ; q < BATCH ; ++q )
+      {
+        const float t = sqrtf( i[q]*i[q] - 2*i[q]*mx + mx*mx + k[q]*k[q] - 2*k[q]*mz + mz*mz ) ;
+        res[q] = t * (mx*mx - 2*i[q]*mx + mz*mz + k[q]*k[q] + my*my - 2*k[q]*mz + j[q]*j[q] - 2*j[q]*my + r*r + i[q]*i[q]) +
+                 (-2*r*mx*mx + 4*r*i[q]*mx + 4*r*k[q]*mz - 2*r*mz*mz - 2*r*i[q]*i[q] - 2*r*k[q]*k[q] ) - t*R*R ;
+      }
+    }
+    break ;
+
+  case cylinder:
+    {
+      const float zmin = _min[Z][p], zmax = _max[Z][p] ;
+      for( int q = 0 ; q < BATCH ; ++q )
+      {
+        const float v = (x[q]-mx)*(x[q]-mx) + (y[q]-my)*(y[q]-my) - r*r ;
+        const float w = ( z[q] > zmax ) ? 1.0f : v ;
+        res[q] = ( z[q] < zmin ) ? 1.0f : w ;
+      }
+    }
+    break ;
+
+  case cone:
+    {
+      const float zmin = _min[Z][p], zmax = _max[Z][p] ;
+      for( int q = 0 ; q < BATCH ; ++q )
+      {
+        // sqrtf rather than hypot, which does not vectorize
+        const float v = sqrtf( x[q]*x[q] + y[q]*y[q] ) - ( r + (z[q]-zmin)/(zmax-zmin)*(R-r) ) ;
+        const float w = ( z[q] > zmax ) ? 1.0f : v ;
+        res[q] = ( z[q] < zmin ) ? 1.0f : w ;
+      }
+    }
+    break ;
+
+  case block:
+    {
+      const float xmin = _min[X][p], ymin = _min[Y][p], zmin = _min[Z][p] ;
+      const float xmax = _max[X][p], ymax = _max[Y][p], zmax = _max[Z][p] ;
+      for( int q = 0 ; q < BATCH ; ++q )
+        res[q] = ( (x[q] < xmin) | (y[q] < ymin) | (z[q] < zmin) | (x[q] > xmax) | (y[q] > ymax) | (z[q] > zmax) ) ? 1.0f : -1.0f ;
+    }
+    break ;
+
+  default :
+    for( int q = 0 ; q < BATCH ; ++q ) res[q] = 0 ;
+    break ;
+  }
+
+  for( int q = 0 ; q < BATCH ; ++q ) res[q] = ( res[q] == res[q] ) ? res[q] : 0.0f ;  // invalid calculus
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// Pruning: the range of every node over a box is bounded with interval
+// arithmetic.  The primitives are not distance fields, so a Lipschitz bound
+// would not be tight; their ranges are computed from the closed forms instead,
+// and collapse to the outside value on boxes away from their support, which
+// plays the part of the bounding boxes.  An operand of a Union, an Inter or a
+// Diff whose range cannot win the min or the max inside the box is removed
+// from the code evaluated there.
+//_____________________________________________________________________________
+
+// relative margin added to the ranges computed in floating point, larger than
+// the rounding of the expanded formulas of eval_primitive
+static const float CSG_SLACK = 1e-5f ;
+
+// smallest number of samples of a cell that is further subdivided
+static const int CSG_CELL = 256 ;
+
+//_____________________________________________________________________________
+// range of (u-m)^2 for u in [lo,hi]
+static inline void sq_range( float lo, float hi, float m, float &vmin, float &vmax )
+//-----------------------------------------------------------------------------
+{
+  const float a = lo - m, b = hi - m ;
+  vmax = ( a*a > b*b ) ? a*a : b*b ;
+  vmin = ( a > 0 ) ? a*a : ( b < 0 ) ? b*b : 0.0f ;
+}
+//_____________________________________________________________________________
+
+//_____________________________________________________________________________
+// range of the product of two ranges
+static inline void mul_range( float alo, float ahi, float blo, float bhi, float &vmin, float &vmax )
+//-----------------------------------------------------------------------------
+{
+  const float p[4] = { alo*blo, alo*bhi, ahi*blo, ahi*bhi } ;
+  vmin = vmax = p[0] ;
+  for( int l = 1 ; l < 4 ; ++l )
+  {
+    if( p[l] < vmin ) vmin = p[l] ;
+    if( p[l] > vmax ) vmax = p[l] ;
+  }
+}
+//_____________________________________________________________________________
+
+//_____________________________________________________________________________
+// range of u^4 - 5 u^2 for u in [lo,hi]
+static inline void tangle_range( float lo, float hi, float &vmin, float &vmax )
+//-----------------------------------------------------------------------------
+{
+  const float c[5] = { lo, hi, 0.0f, -sqrtf(2.5f), sqrtf(2.5f) } ;
+  vmin =  HUGE_VALF ;
+  vmax = -HUGE_VALF ;
+  for( int l = 0 ; l < 5 ; ++l )
+  {
+    if( c[l] < lo || c[l] > hi ) continue ;
+    const float v = c[l]*c[l]*c[l]*c[l] - 5*c[l]*c[l] ;
+    if( v < vmin ) vmin = v ;
+    if( v > vmax ) vmax = v ;
+  }
+}
+//_____________________________________________________________________________
+
+//_____________________________________________________________________________
+// widens a computed range by the rounding of terms of magnitude mag
+static inline void widen( float &vmin, float &vmax, float mag )
+//-----------------------------------------------------------------------------
+{
+  const float e = CSG_SLACK * ( 1 + fabsf(mag) ) ;
+  vmin -= e ;
+  vmax += e ;
+  if( !( fabsf(vmin) < HUGE_VALF ) || !( fabsf(vmax) < HUGE_VALF ) || !( e < HUGE_VALF ) )
+  {
+    // overflow or invalid calculus
+    vmin = -HUGE_VALF ;
+    vmax =  HUGE_VALF ;
+  }
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// range of primitive p over a box
+void CSG_Program::bound_primitive( int p, const float lo[3], const float hi[3], float &vmin, float &vmax ) const
+//-----------------------------------------------------------------------------
+{
+  const float mx = _med[X][p], my = _med[Y][p], mz = _med[Z][p] ;
+  const float r  = _r[p], R = _R[p] ;
+  float ax, bx, ay, by, az, bz ;
+
+  switch( _prim[p] )
+  {
+  case sphere:
+    sq_range( lo[X], hi[X], mx, ax, bx ) ;
+    sq_range( lo[Y], hi[Y], my, ay, by ) ;
+    sq_range( lo[Z], hi[Z], mz, az, bz ) ;
+    vmin = ax + ay + az - r*r ;
+    vmax = bx + by + bz - r*r ;
+    widen( vmin, vmax, bx + by + bz + r*r ) ;
+    break ;
+
+  case heart:
+    {
+      sq_range( lo[X], hi[X], 0, ax, bx ) ;
+      sq_range( lo[Y], hi[Y], 0, ay, by ) ;
+      sq_range( lo[Z], hi[Z], 0, az, bz ) ;
+      const float hlo = 2*ax + ay + az - 1, hhi = 2*bx + by + bz - 1 ;
+      float plo, phi ;
+      mul_range( ay, by, lo[Z]*lo[Z]*lo[Z], hi[Z]*hi[Z]*hi[Z], plo, phi ) ;
+      vmin = hlo*hlo*hlo - phi ;
+      vmax = hhi*hhi*hhi - plo ;
+      const float h = 2*bx + by + bz + 1 ;
+      widen( vmin, vmax, h*h*h + ( fabsf(plo) > fabsf(phi) ? fabsf(plo) : fabsf(phi) ) ) ;
+    }
+    break ;
+
+  case tangle:
+    {
+      tangle_range( lo[X], hi[X], ax, bx ) ;
+      tangle_range( lo[Y], hi[Y], ay, by ) ;
+      tangle_range( lo[Z], hi[Z], az, bz ) ;
+      vmin = ax + ay + az + 11.8f ;
+      vmax = bx + by + bz + 11.8f ;
+      float s = 0 ;
+      for( int a = X ; a <= Z ; ++a )
+      {
+        const float u = fabsf(lo[a]) > fabsf(hi[a]) ? fabsf(lo[a]) : fabsf(hi[a]) ;
+        s += u*u*u*u + 5*u*u ;
+      }
+      widen( vmin, vmax, s + 11.8f ) ;
+    }
+    break ;
+
+  case torus:
+    {
+      // the expanded formula of eval_primitive is t ((t-r)^2 + (j-my)^2 - R^2)
+      float ilo = 0, ihi = 0, jlo = 0, jhi = 0, klo = 0, khi = 0 ;
+      switch( _axe[p] )
+      {
+      case X : ilo = lo[X] ; ihi = hi[X] ; jlo = lo[Y] ; jhi = hi[Y] ; klo = lo[Z] ; khi = hi[Z] ; break ;
+      case Y : ilo = lo[Y] ; ihi = hi[Y] ; jlo = lo[Z] ; jhi = hi[Z] ; klo = lo[X] ; khi = hi[X] ; break ;
+      case Z : ilo = lo[Z] ; ihi = hi[Z] ; jlo = lo[X] ; jhi = hi[X] ; klo = lo[Y] ; khi = hi[Y] ; break ;
+      }
+      sq_range( ilo, ihi, mx, ax, bx ) ;
+      sq_range( klo, khi, mz, az, bz ) ;
+      const float tlo = sqrtf( ax + az ), thi = sqrtf( bx + bz ) ;
+      float ulo, uhi ;
+      sq_range( tlo, thi, r, ulo, uhi ) ;
+      sq_range( jlo, jhi, my, ay, by ) ;
+      mul_range( tlo, thi, ulo + ay - R*R, uhi + by - R*R, vmin, vmax ) ;
+
+      float s = fabsf(r) + fabsf(R) ;
+      const float c[9] = { ilo, ihi, jlo, jhi, klo, khi, mx, my, mz } ;
+      for( int l = 0 ; l < 9 ; ++l ) s += fabsf(c[l]) ;
+      widen( vmin, vmax, ( thi + fabsf(r) + 1 ) * s*s ) ;
+    }
+    break ;
+
+  case cylinder:
+  case cone:
+    {
+      const float zmin = _min[Z][p], zmax = _max[Z][p] ;
+      if( lo[Z] > zmax || hi[Z] < zmin ) { vmin = vmax = 1.0f ; break ; }
+
+      if( _prim[p] == cylinder )
+      {
+        sq_range( lo[X], hi[X], mx, ax, bx ) ;
+        sq_range( lo[Y], hi[Y], my, ay, by ) ;
+        vmin = ax + ay - r*r ;
+        vmax = bx + by - r*r ;
+        widen( vmin, vmax, bx + by + r*r ) ;
+      }
+      else
+      {
+        if( !( zmax > zmin ) ) { vmin = -HUGE_VALF ; vmax = HUGE_VALF ; break ; }
+        sq_range( lo[X], hi[X], 0, ax, bx ) ;
+        sq_range( lo[Y], hi[Y], 0, ay, by ) ;
+        const float zlo = lo[Z] < zmin ? zmin : lo[Z] ;
+        const float zhi = hi[Z] > zmax ? zmax : hi[Z] ;
+        const float l0 = r + (zlo-zmin)/(zmax-zmin)*(R-r) ;
+        const float l1 = r + (zhi-zmin)/(zmax-zmin)*(R-r) ;
+        vmin = sqrtf( ax + ay ) - ( l0 > l1 ? l0 : l1 ) ;
+        vmax = sqrtf( bx + by ) - ( l0 < l1 ? l0 : l1 ) ;
+        widen( vmin, vmax, sqrtf( bx + by ) + fabsf(r) + fabsf(R) ) ;
+      }
+
+      // the box reaches past the ends
+      if( lo[Z] < zmin || hi[Z] > zmax )
+      {
+        if( vmin > 1.0f ) vmin = 1.0f ;
+        if( vmax < 1.0f ) vmax = 1.0f ;
+      }
+    }
+    break ;
+
+  case block:
+    {
+      bool out = false, in = true ;
+      for( int a = X ; a <= Z ; ++a )
+      {
+        out = out || lo[a] > _max[a][p] || hi[a] < _min[a][p] ;
+        in  = in  && lo[a] >= _min[a][p] && hi[a] <= _max[a][p] ;
+      }
+      vmin = out ? 1.0f : -1.0f ;
+      vmax = in ? -1.0f : 1.0f ;
+    }
+    break ;
+
+  default :
+    vmin = vmax = 0 ;
+    break ;
+  }
+
+  // invalid calculus evaluates to 0
+  if( vmin != vmin || vmax != vmax ) { vmin = -HUGE_VALF ; vmax = HUGE_VALF ; }
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// conservative range of the program over a box
+void CSG_Program::bound( const float lo[3], const float hi[3], float &vmin, float &vmax ) const
+//-----------------------------------------------------------------------------
+{
+  if( empty() ) { vmin = vmax = 0 ; return ; }
+  std::vector<int> out ;
+  prune( _code, lo, hi, out, vmin, vmax ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// copies code into out restricted to a box
+void CSG_Program::prune( const std::vector<int> &code, const float lo[3], const float hi[3], std::vector<int> &out, float &vmin, float &vmax ) const
+//-----------------------------------------------------------------------------
+{
+  // start of the subtree ending at each position
+  std::vector<int> start( code.size() ), stack ;
+  for( size_t ip = 0 ; ip < code.size() ; ++ip )
+  {
+    if( code[ip] >= 0 )
+      stack.push_back( (int)ip ) ;
+    else if( code[ip] != -Neg )
+      stack.pop_back() ;
+    start[ip] = stack.back() ;
+  }
+
+  out.clear() ;
+  out.reserve( code.size() ) ;
+  prune_node( code, start, (int)code.size() - 1, lo, hi, out, vmin, vmax ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// copies a subtree without the operands that cannot change its result inside the box
+void CSG_Program::prune_node( const std::vector<int> &code, const std::vector<int> &start, int end,
+                              const float lo[3], const float hi[3], std::vector<int> &out, float &vmin, float &vmax ) const
+//-----------------------------------------------------------------------------
+{
+  const int c = code[end] ;
+  if( c >= 0 )
+  {
+    bound_primitive( c, lo, hi, vmin, vmax ) ;
+    out.push_back( c ) ;
+    return ;
+  }
+
+  if( c == -Neg )
+  {
+    prune_node( code, start, end-1, lo, hi, out, vmin, vmax ) ;
+    if( out.back() == -Neg ) out.pop_back() ; else out.push_back( -Neg ) ;
+    const float t = vmin ;  vmin = -vmax ;  vmax = -t ;
+    return ;
+  }
+
+  // the left operand ends right before the right one starts
+  const size_t a0 = out.size() ;
+  float amin, amax, bmin, bmax ;
+  prune_node( code, start, start[end-1] - 1, lo, hi, out, amin, amax ) ;
+  const size_t b0 = out.size() ;
+  prune_node( code, start, end-1, lo, hi, out, bmin, bmax ) ;
+
+  // operand kept alone: 1 for the left one, 2 for the right one, 0 for both
+  int keep = 0 ;
+  switch( -c )
+  {
+  case Union :
+    if( amax <= bmin ) keep = 1 ; else if( bmax <= amin ) keep = 2 ;
+    vmin = amin < bmin ? amin : bmin ;
+    vmax = amax < bmax ? amax : bmax ;
+    break ;
+
+  case Inter :
+    if( amin >= bmax ) keep = 1 ; else if( bmin >= amax ) keep = 2 ;
+    vmin = amin > bmin ? amin : bmin ;
+    vmax = amax > bmax ? amax : bmax ;
+    break ;
+
+  case Diff :
+    if( amin >= -bmin ) keep = 1 ; else if( -bmax >= amax ) keep = 2 ;
+    vmin = amin > -bmax ? amin : -bmax ;
+    vmax = amax > -bmin ? amax : -bmin ;
+    break ;
+  }
+
+  if( keep == 1 )
+    out.resize( b0 ) ;
+  else if( keep == 2 )
+  {
+    out.erase( out.begin() + a0, out.begin() + b0 ) ;
+    if( c == -Diff )
+    {
+      if( out.back() == -Neg ) out.pop_back() ; else out.push_back( -Neg ) ;
+    }
+  }
+  else
+    out.push_back( c ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// samples the program on a regular grid
+void CSG_Program::sample( const float org[3], const float step[3], const int n[3], float *res ) const
+//-----------------------------------------------------------------------------
+{
+  if( n[X] <= 0 || n[Y] <= 0 || n[Z] <= 0 ) return ;
+  if( empty() ) { memset( res, 0, (size_t)n[X] * n[Y] * n[Z] * sizeof(float) ) ; return ; }
+
+  const int i0[3] = { 0, 0, 0 } ;
+  sample_cell( _code, i0, n, org, step, n, res ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// samples the cell [i0,i1[ of the grid
+void CSG_Program::sample_cell( const std::vector<int> &code, const int i0[3], const int i1[3],
+                               const float org[3], const float step[3], const int n[3], float *res ) const
+//-----------------------------------------------------------------------------
+{
+  // box of the samples of the cell
+  float lo[3], hi[3] ;
+  int   m[3] ;
+  for( int a = X ; a <= Z ; ++a )
+  {
+    const float u = (float)i0[a] * step[a] + org[a] ;
+    const float v = (float)(i1[a]-1) * step[a] + org[a] ;
+    lo[a] = u < v ? u : v ;
+    hi[a] = u < v ? v : u ;
+    m [a] = i1[a] - i0[a] ;
+  }
+  const int np = m[X] * m[Y] * m[Z] ;
+
+  std::vector<int> sub ;
+  float vmin, vmax ;
+  prune( code, lo, hi, sub, vmin, vmax ) ;
+
+  if( vmin == vmax )
+  {
+    // constant on the cell
+    for( int i = i0[X] ; i < i1[X] ; ++i )
+      for( int j = i0[Y] ; j < i1[Y] ; ++j )
+        for( int k = i0[Z] ; k < i1[Z] ; ++k )
+          res[ k + n[Z] * ( j + n[Y] * i ) ] = vmin ;
+    return ;
+  }
+
+  if( sub.size() > 1 && np > CSG_CELL )
+  {
+    // splits the longest side
+    int a = X ;
+    if( m[Y] > m[a] ) a = Y ;
+    if( m[Z] > m[a] ) a = Z ;
+    int c0[3] = { i0[X], i0[Y], i0[Z] }, c1[3] = { i1[X], i1[Y], i1[Z] } ;
+    c0[a] = c1[a] = i0[a] + m[a] / 2 ;
+    sample_cell( sub, i0, c1, org, step, n, res ) ;
+    sample_cell( sub, c0, i1, org, step, n, res ) ;
+    return ;
+  }
+
+  std::vector<float> x( np ), y( np ), z( np ), v( np ) ;
+  int q = 0 ;
+  for( int i = i0[X] ; i < i1[X] ; ++i )
+    for( int j = i0[Y] ; j < i1[Y] ; ++j )
+      for( int k = i0[Z] ; k < i1[Z] ; ++k, ++q )
+      {
+        x[q] = (float)i * step[X] + org[X] ;
+        y[q] = (float)j * step[Y] + org[Y] ;
+        z[q] = (float)k * step[Z] + org[Z] ;
+      }
+  eval_code( sub, x.data(), y.data(), z.data(), v.data(), np ) ;
+
+  q = 0 ;
+  for( int i = i0[X] ; i < i1[X] ; ++i )
+    for( int j = i0[Y] ; j < i1[Y] ; ++j )
+      for( int k = i0[Z] ; k < i1[Z] ; ++k, ++q )
+        res[ k + n[Z] * ( j + n[Y] * i ) ] = v[q] ;
+}
+//_____________________________________________________________________________
@@ -0,0 +1,111 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// CSG program
+// Flattened CSG tree evaluated by batches of points
+//
+//________________________________________________
+
+#ifndef _CSG_PROGRAM_H_
+#define _CSG_PROGRAM_H_
+
+#include <vector>
+#include "csg.h"
+
+//_____________________________________________________________________________
+// CSG tree compiled into a postfix program over a primitive table
+class CSG_Program
+//-----------------------------------------------------------------------------
+{
+//-----------------------------------------------------------------------------
+// Constructors
+public :
+  /** number of points evaluated together by the inner loops */
+  enum { BATCH = 16 } ;
+
+  CSG_Program() : _depth(0) {}
+  CSG_Program( const CSG_Node *root ) : _depth(0) { compile( root ) ; }
+
+//-----------------------------------------------------------------------------
+// Operations
+public :
+  /** flattens a parsed tree, replacing the previous program */
+  void compile( const CSG_Node *root ) ;
+
+  /** true if nothing has been compiled */
+  inline bool empty() const { return _code.empty() ; }
+
+  /**
+   * evaluates the program at n points, with the same results as CSG_Node::eval
+   * \param x, y, z coordinates of the points
+   * \param res     values of the points
+   */
+  void eval( const float *x, const float *y, const float *z, float *res, int n ) const ;
+
+  /** evaluates the program at a single point */
+  inline float eval( float x, float y, float z ) const { float res ; eval( &x, &y, &z, &res, 1 ) ; return res ; }
+
+  /**
+   * conservative range of the program over a box
+   * \param lo, hi corners of the box
+   * \param vmin, vmax bounds of the values taken inside the box
+   */
+  void bound( const float lo[3], const float hi[3], float &vmin, float &vmax ) const ;
+
+  /**
+   * samples the program on a regular grid, pruning the tree on the cells of a recursive subdivision of the grid
+   * \param org  position of the sample (0,0,0), the sample (i,j,k) lies at (float)i*step[X] + org[X], ...
+   * \param step spacing between the samples
+   * \param n    number of samples along each axis
+   * \param res  values of the samples, stored as res[ k + n[Z]*( j + n[Y]*i ) ]
+   */
+  void sample( const float org[3], const float step[3], const int n[3], float *res ) const ;
+
+private :
+  /** appends the postfix code of a subtree */
+  void compile_node( const CSG_Node *node ) ;
+  /** adds a primitive to the table and returns its index */
+  int  add_primitive( const CSG_Node *node ) ;
+  /** evaluates code at n points */
+  void eval_code( const std::vector<int> &code, const float *x, const float *y, const float *z, float *res, int n ) const ;
+  /** evaluates one full batch, leaving the result on stack[0..BATCH[ */
+  void eval_batch( const std::vector<int> &code, const float *x, const float *y, const float *z, float *stack ) const ;
+  /** evaluates primitive p on a batch */
+  void eval_primitive( int p, const float *x, const float *y, const float *z, float *res ) const ;
+
+  /** range of primitive p over a box */
+  void bound_primitive( int p, const float lo[3], const float hi[3], float &vmin, float &vmax ) const ;
+  /**
+   * copies the subtree of code ending at end into out, without the operands that cannot change the result inside the box
+   * \param start start of the subtree ending at each position of code
+   * \return range of the subtree over the box
+   */
+  void prune_node( const std::vector<int> &code, const std::vector<int> &start, int end,
+                   const float lo[3], const float hi[3], std::vector<int> &out, float &vmin, float &vmax ) const ;
+  /** copies code into out restricted to a box, returns the range of code over the box */
+  void prune( const std::vector<int> &code, const float lo[3], const float hi[3], std::vector<int> &out, float &vmin, float &vmax ) const ;
+  /** samples the cell [i0,i1[ of the grid of sample() with code */
+  void sample_cell( const std::vector<int> &code, const int i0[3], const int i1[3],
+                    const float org[3], const float step[3], const int n[3], float *res ) const ;
+
+//-----------------------------------------------------------------------------
+// Elements
+private :
+  /** negation of the operand on top of the stack, only produced by pruning */
+  enum { Neg = Diff + 1 } ;
+
+  std::vector<int>   _code  ;  /**< postfix program: primitive index if >= 0, -Operation or -Neg otherwise */
+  int                _depth ;  /**< maximal stack depth of the program */
+  int                _height;  /**< stack height while compiling */
+
+  // primitive table, as a structure of arrays
+  std::vector<Primitive> _prim ;
+  std::vector<float> _med[3], _min[3], _max[3] ;
+  std::vector<float> _r, _R ;
+  std::vector<int>   _axe ;    /**< torus axis, -1 if invalid */
+};
+//_____________________________________________________________________________
+
+
+#endif // _CSG_PROGRAM_H_
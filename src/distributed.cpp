@@ -0,0 +1,292 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// Distributed extraction
+// Bricks tesselated by worker processes
+//
+//________________________________________________
+
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <limits>
+#ifndef WIN32
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif // WIN32
+#include "distributed.h"
+#include "mesh_merge.h"
+#include "trace.h"
+
+
+#ifndef WIN32
+
+#ifdef MSG_NOSIGNAL
+static const int SEND_FLAGS = MSG_NOSIGNAL ;
+#else  // MSG_NOSIGNAL
+static const int SEND_FLAGS = 0 ;
+#endif // MSG_NOSIGNAL
+
+//_____________________________________________________________________________
+// sends n bytes
+static bool send_all( int fd, const void *buf, size_t n )
+//-----------------------------------------------------------------------------
+{
+  const char *p = (const char*)buf ;
+  while( n > 0 )
+  {
+    const ssize_t w = send( fd, p, n, SEND_FLAGS ) ;
+    if( w <= 0 ) return false ;
+    p += w ;  n -= w ;
+  }
+  return true ;
+}
+//_____________________________________________________________________________
+
+//_____________________________________________________________________________
+// receives n bytes
+static bool recv_all( int fd, void *buf, size_t n )
+//-----------------------------------------------------------------------------
+{
+  char *p = (char*)buf ;
+  while( n > 0 )
+  {
+    const ssize_t r = recv( fd, p, n, 0 ) ;
+    if( r <= 0 ) return false ;
+    p += r ;  n -= r ;
+  }
+  return true ;
+}
+//_____________________________________________________________________________
+
+#endif // WIN32
+
+
+
+//_____________________________________________________________________________
+// worker loop
+int DistributedExtractor::serve( int fd )
+//-----------------------------------------------------------------------------
+{
+#ifdef WIN32
+  return 1 ;
+#else  // WIN32
+  MarchingCubes mc ;
+  std::vector<float> data ;
+  for(;;)
+  {
+    Task task ;
+    if( !recv_all( fd, &task, sizeof(task) ) ) return 1 ;
+    if( task.brick < 0 ) return 0 ;
+
+    MC_TRACE_SPAN( "worker brick" ) ;
+    const glm::ivec3 n( task.n[0], task.n[1], task.n[2] ) ;
+    data.resize( (size_t)n.x * n.y * n.z ) ;
+    if( !recv_all( fd, data.data(), data.size() * sizeof(float) ) ) return 1 ;
+
+    mc.set_method( task.original != 0 ) ;
+    mc.set_resolution( n.x, n.y, n.z ) ;
+    mc.set_region( glm::ivec3( task.lo[0], task.lo[1], task.lo[2] ), glm::ivec3( task.hi[0], task.hi[1], task.hi[2] ),
+                   glm::ivec3( task.first[0], task.first[1], task.first[2] ) ) ;
+    mc.set_edge_keys( true, glm::ivec3( task.global[0], task.global[1], task.global[2] ) ) ;
+    glm::mat4 m ;
+    for( int c = 0 ; c < 16 ; ++c ) m[c/4][c%4] = task.transform[c] ;
+    mc.set_transform( m ) ;
+    mc.init_all() ;
+    for( int k = 0 ; k < n.z ; ++k )
+    for( int j = 0 ; j < n.y ; ++j )
+    for( int i = 0 ; i < n.x ; ++i )
+      mc.set_data( data[ i + n.x * ( j + (size_t)n.y * k ) ], i,j,k ) ;
+    mc.run( task.iso ) ;
+
+    const Result res = { task.brick, mc.nverts(), mc.ntrigs() } ;
+    if( !send_all( fd, &res, sizeof(res) ) ||
+        !send_all( fd, mc.vertices (), res.nv * sizeof(Vertex  ) ) ||
+        !send_all( fd, mc.keys     (), res.nv * sizeof(int64_t ) ) ||
+        !send_all( fd, mc.triangles(), res.nt * sizeof(Triangle) ) ) return 1 ;
+  }
+#endif // WIN32
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// tesselates the grid on worker processes
+bool DistributedExtractor::run( MarchingCubes &mc, const SampleFunction &f, real iso )
+//-----------------------------------------------------------------------------
+{
+  _nsent = 0 ;
+#ifdef WIN32
+  printf( "DistributedExtractor::run error : no worker processes on this platform\n" ) ;
+  return false ;
+#else  // WIN32
+  const glm::ivec3 size( mc.size_x(), mc.size_y(), mc.size_z() ) ;
+  const int B = _brick ;
+  const glm::ivec3 nb( MarchingCubes::brick_count( size.x, B ), MarchingCubes::brick_count( size.y, B ), MarchingCubes::brick_count( size.z, B ) ) ;
+  const int nbricks = nb.x * nb.y * nb.z ;
+
+  // workers
+  std::vector<int>   fds ;
+  std::vector<pid_t> pids ;
+  for( int w = 0 ; w < _nprocs ; ++w )
+  {
+    int sv[2] ;
+    if( socketpair( AF_UNIX, SOCK_STREAM, 0, sv ) != 0 ) break ;
+    const pid_t pid = fork() ;
+    if( pid == 0 )
+    {
+      for( int fd : fds ) ::close( fd ) ;
+      ::close( sv[0] ) ;
+      _exit( serve( sv[1] ) ) ;
+    }
+    ::close( sv[1] ) ;
+    if( pid < 0 ) { ::close( sv[0] ) ;  break ; }
+#ifdef SO_NOSIGPIPE
+    const int one = 1 ;
+    setsockopt( sv[0], SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one) ) ;
+#endif // SO_NOSIGPIPE
+    fds .push_back( sv[0] ) ;
+    pids.push_back( pid ) ;
+  }
+  bool ok = !fds.empty() ;
+  if( !ok ) printf( "DistributedExtractor::run error : cannot start the workers\n" ) ;
+
+  // sends the next brick crossing the isosurface to worker w, false once all the bricks are sent
+  int next = 0 ;
+  std::vector<float> data ;
+  auto dispatch = [&]( int w ) -> bool
+  {
+    for( ; next < nbricks ; ++next )
+    {
+      MC_TRACE_SPAN( "sample brick" ) ;
+      const glm::ivec3 bc( next % nb.x, ( next / nb.x ) % nb.y, next / ( nb.x * nb.y ) ) ;
+      const glm::ivec3 lo  = bc * B ;
+      const glm::ivec3 hi  = glm::min( lo + B, size - 1 ) ;
+      const glm::ivec3 glo = glm::max( lo - 1, glm::ivec3( 0 ) ) ;
+      const glm::ivec3 ghi = glm::min( hi + 1, size - 1 ) ;
+      const glm::ivec3 n   = ghi - glo + 1 ;
+      data.resize( (size_t)n.x * n.y * n.z ) ;
+      f( glo, glm::ivec3( 1 ), n, data.data() ) ;
+
+      // same sign convention as run : a brick without sign change has no vertex
+      bool pos = false, neg = false ;
+      for( int k = lo.z ; k <= hi.z && !( pos && neg ) ; ++k )
+      for( int j = lo.y ; j <= hi.y ; ++j )
+      for( int i = lo.x ; i <= hi.x ; ++i )
+      {
+        const glm::ivec3 l = glm::ivec3( i, j, k ) - glo ;
+        if( data[ l.x + n.x * ( l.y + (size_t)n.y * l.z ) ] - iso <= -std::numeric_limits<float>::epsilon() ) neg = true ; else pos = true ;
+      }
+      if( !( pos && neg ) ) continue ;
+
+      Task task ;
+      task.brick    = next++ ;
+      task.original = mc._originalMC ;
+      task.iso      = iso ;
+      for( int c = 0 ; c < 16 ; ++c ) task.transform[c] = mc._transform[c/4][c%4] ;
+      for( int a = 0 ; a < 3 ; ++a )
+      {
+        task.first [a] = glo[a] ;
+        task.n     [a] = n[a] ;
+        task.lo    [a] = lo[a] - glo[a] ;
+        task.hi    [a] = hi[a] - glo[a] ;
+        task.global[a] = size[a] ;
+      }
+      ok = ok && send_all( fds[w], &task, sizeof(task) ) && send_all( fds[w], data.data(), data.size() * sizeof(float) ) ;
+      ++_nsent ;
+      return true ;
+    }
+    return false ;
+  } ;
+
+  // one brick in flight per worker, the meshes kept by brick until the end in an arena released in one shot
+  struct Piece { MCBuffer<Vertex> verts ; MCBuffer<int64_t> keys ; MCBuffer<Triangle> trigs ; } ;
+  MonotonicArena arena ;
+  std::vector<Piece> pieces( nbricks ) ;
+  std::vector<uchar> busy( fds.size() ) ;
+  int nbusy = 0 ;
+  for( size_t w = 0 ; w < fds.size() && ok ; ++w )
+    if( ( busy[w] = dispatch( (int)w ) ) ) ++nbusy ;
+
+  std::vector<pollfd> pfds ;
+  while( ok && nbusy > 0 )
+  {
+    pfds.clear() ;
+    for( size_t w = 0 ; w < fds.size() ; ++w )
+      if( busy[w] ) { pollfd p = { fds[w], POLLIN, 0 } ;  pfds.push_back( p ) ; }
+    if( poll( pfds.data(), pfds.size(), -1 ) < 0 ) { ok = false ;  break ; }
+
+    for( const pollfd &p : pfds )
+    {
+      if( !p.revents ) continue ;
+      MC_TRACE_SPAN( "receive brick" ) ;
+      const int w = (int)( std::find( fds.begin(), fds.end(), p.fd ) - fds.begin() ) ;
+      Result res ;
+      ok = recv_all( p.fd, &res, sizeof(res) ) && res.brick >= 0 && res.brick < nbricks && res.nv >= 0 && res.nt >= 0 ;
+      if( !ok ) break ;
+      Piece &piece = pieces[res.brick] ;
+      piece.verts = MCBuffer<Vertex  >( res.nv, Vertex  (), &arena ) ;
+      piece.keys  = MCBuffer<int64_t >( res.nv, int64_t (), &arena ) ;
+      piece.trigs = MCBuffer<Triangle>( res.nt, Triangle(), &arena ) ;
+      ok = recv_all( p.fd, piece.verts.data(), res.nv * sizeof(Vertex  ) ) &&
+           recv_all( p.fd, piece.keys .data(), res.nv * sizeof(int64_t ) ) &&
+           recv_all( p.fd, piece.trigs.data(), res.nt * sizeof(Triangle) ) ;
+      if( !ok ) break ;
+      if( !( busy[w] = dispatch( w ) ) ) --nbusy ;
+    }
+  }
+
+  // stops the workers
+  Task end ;
+  memset( &end, 0, sizeof(end) ) ;
+  end.brick = -1 ;
+  for( int fd : fds )
+  {
+    if( ok ) send_all( fd, &end, sizeof(end) ) ;
+    ::close( fd ) ;
+  }
+  for( pid_t pid : pids )
+  {
+    if( !ok ) kill( pid, SIGTERM ) ;
+    int status ;
+    waitpid( pid, &status, 0 ) ;
+  }
+  if( !ok )
+  {
+    printf( "DistributedExtractor::run error : a worker failed\n" ) ;
+    return false ;
+  }
+
+  // welds the bricks in their order
+  MC_TRACE_SPAN( "merge" ) ;
+  MeshMerger merger( mc.resource() ) ;
+  for( Piece &p : pieces )
+  {
+    merger.add( p.verts.data(), p.keys.data(), p.verts.size(), p.trigs.data(), p.trigs.size() ) ;
+    p = Piece() ;
+  }
+  mc._vertices .swap( merger.vertices () ) ;
+  mc._triangles.swap( merger.triangles() ) ;
+  if( mc._keyed ) mc._keys.swap( merger.keys() ) ;
+  else            mc._keys.clear() ;
+
+  // the gradient of the coordinator
+  if( mc._gradient )
+  {
+    for( Vertex &v : mc._vertices )
+    {
+      const glm::vec3 n = mc.world_normal( mc.analytic_normal( mc.grid_position( glm::vec3( v.x, v.y, v.z ) ) ) ) ;
+      v.nx = n.x ;  v.ny = n.y ;  v.nz = n.z ;
+    }
+  }
+  return true ;
+#endif // WIN32
+}
+//_____________________________________________________________________________
@@ -0,0 +1,76 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// Distributed extraction
+// Bricks tesselated by worker processes
+//
+//________________________________________________
+
+
+#ifndef _DISTRIBUTED_H_
+#define _DISTRIBUTED_H_
+
+#include <stdint.h>
+#include <vector>
+#include "MarchingCubes.h"
+
+//_____________________________________________________________________________
+// Multi-process extractor
+/** \class DistributedExtractor
+  * \brief Coordinator sampling the grid by bricks with one ghost layer and sending them to worker processes over
+  * local sockets. The workers tesselate the bricks with keyed vertices and return their meshes, which the coordinator
+  * welds in the order of the bricks : the result is the mesh of MarchingCubes::run, without the whole grid in memory.
+  * The workers are forked by run, or started by any other mean on a socket given to serve.
+  */
+class DistributedExtractor
+//-----------------------------------------------------------------------------
+{
+//-----------------------------------------------------------------------------
+// Constructors
+public :
+  /**
+   * \param nprocs number of worker processes
+   * \param brick  edge of the bricks, in cubes
+   */
+  DistributedExtractor( int nprocs = 2, int brick = 64 ) : _nprocs( std::max( nprocs, 1 ) ), _brick( std::max( brick, 1 ) ), _nsent(0) {}
+
+//-----------------------------------------------------------------------------
+// Operations
+public :
+  /**
+   * replaces the mesh of mc by the tesselation of the grid sampled by f, on forked worker processes
+   * \param mc  size, method, transform, gradient and keys of the extraction : its grid is not used
+   * \param f   sampling callback, called from the calling process only
+   * \param iso isovalue
+   * \return false if the workers could not be started or failed
+   */
+  bool run( MarchingCubes &mc, const SampleFunction &f, real iso = (real)0.0 ) ;
+
+  /**
+   * worker loop : tesselates the bricks received on fd until the end message
+   * \param fd connected socket of the coordinator
+   * \return 0 on the end message, 1 on an error
+   */
+  static int serve( int fd ) ;
+
+  /** number of bricks sent to the workers by the last run */
+  inline int nsent() const { return _nsent ; }
+
+private :
+  /** brick message, followed by the samples of the brick and its ghost layer */
+  struct Task   { int32_t brick ; int32_t first[3], n[3], lo[3], hi[3], global[3] ; int32_t original ; float iso ; float transform[16] ; } ;
+  /** mesh message, followed by the vertices, their keys and the triangles */
+  struct Result { int32_t brick ; int32_t nv, nt ; } ;
+
+//-----------------------------------------------------------------------------
+// Elements
+private :
+  int _nprocs ;  /**< number of worker processes */
+  int _brick  ;  /**< edge of the bricks */
+  int _nsent  ;  /**< bricks sent to the workers */
+};
+//_____________________________________________________________________________
+
+
+#endif // _DISTRIBUTED_H_
@@ -32,6 +32,8 @@
 #include <cmath>
 #include <new>
 #include <algorithm>
+#include <limits>
+#include <vector>
 
 using namespace std;
 
@@ -232,7 +234,7 @@ FunctionParser::Data::Data():
     useDegreeConversion(false),
     ByteCode(0), ByteCodeSize(0),
     Immed(0), ImmedSize(0),
-    Stack(0), StackSize(0)
+    Stack(0), GradStack(0), StackSize(0)
 {}
 
 FunctionParser::Data::~Data()
@@ -240,6 +242,7 @@ FunctionParser::Data::~Data()
     delete[] ByteCode; ByteCode=0;
     delete[] Immed; Immed=0;
     delete[] Stack; Stack=0;
+    delete[] GradStack; GradStack=0;
 }
 
 // Makes a deep-copy of Data:
@@ -250,11 +253,12 @@ FunctionParser::Data::Data(const Data& cpy):
     FuncParserNames(cpy.FuncParserNames), FuncParsers(cpy.FuncParsers),
     ByteCode(0), ByteCodeSize(cpy.ByteCodeSize),
     Immed(0), ImmedSize(cpy.ImmedSize),
-    Stack(0), StackSize(cpy.StackSize)
+    Stack(0), GradStack(0), StackSize(cpy.StackSize)
 {
     if(ByteCodeSize) ByteCode = new unsigned[ByteCodeSize];
     if(ImmedSize) Immed = new float[ImmedSize];
     if(StackSize) Stack = new float[StackSize];
+    if(StackSize) GradStack = new float[GradVars*StackSize];
 
     unsigned i ;
     for(i=0; i<ByteCodeSize; ++i) ByteCode[i] = cpy.ByteCode[i];
@@ -632,6 +636,7 @@ bool FunctionParser::Compile(const char* Function)
     delete[] data->ByteCode; data->ByteCode=0;
     delete[] data->Immed; data->Immed=0;
     delete[] data->Stack; data->Stack=0;
+    delete[] data->GradStack; data->GradStack=0;
 
     vector<unsigned> byteCode; byteCode.reserve(1024);
     tempByteCode = &byteCode;
@@ -660,7 +665,10 @@ bool FunctionParser::Compile(const char* Function)
                sizeof(float)*data->ImmedSize);
     }
     if(data->StackSize)
+    {
         data->Stack = new float[data->StackSize];
+        data->GradStack = new float[GradVars*data->StackSize];
+    }
 
     return true;
 }
@@ -1239,6 +1247,709 @@ float FunctionParser::Eval(const float* Vars)
 }
 
 
+//---------------------------------------------------------------------------
+// Interval evaluation
+//---------------------------------------------------------------------------
+//===========================================================================
+// Every opcode of Eval() is mapped to its interval extension. Bounds of the
+// arithmetic operators are computed in float with the same rounding as
+// Eval(), and rounding is monotonic, so they already enclose the values
+// Eval() computes. Library functions are not guaranteed to be monotonic
+// to the last bit, so their bounds are widened by one ulp.
+namespace
+{
+    const float IntervalInf = numeric_limits<float>::infinity();
+
+    inline void Widen(float& lo, float& hi)
+    {
+        lo = nextafterf(lo, -IntervalInf);
+        hi = nextafterf(hi,  IntervalInf);
+    }
+
+    // inf-inf or 0*inf produce NaN: replace by the whole line
+    inline void Sanitize(float& lo, float& hi)
+    {
+        if(lo != lo) lo = -IntervalInf;
+        if(hi != hi) hi =  IntervalInf;
+    }
+
+    inline void Unbounded(float& lo, float& hi)
+    {
+        lo = -IntervalInf; hi = IntervalInf;
+    }
+
+    inline void IntervalMul(float alo, float ahi, float blo, float bhi,
+                            float& lo, float& hi)
+    {
+        const float p0 = alo*blo, p1 = alo*bhi, p2 = ahi*blo, p3 = ahi*bhi;
+        lo = Min(Min(p0, p1), Min(p2, p3));
+        hi = Max(Max(p0, p1), Max(p2, p3));
+    }
+
+    // cos over [lo,hi], computed in double on the period containing lo
+    inline void IntervalCos(float& lo, float& hi)
+    {
+        const double twoPi = 2*M_PI;
+        if(!(hi - lo < twoPi)) { lo = -1; hi = 1; return; }
+        const double k = floor(lo / twoPi);
+        const double a = lo - k*twoPi, b = hi - k*twoPi;
+        const double ca = cos(a), cb = cos(b);
+        double rlo = ca<cb ? ca : cb, rhi = ca>cb ? ca : cb;
+        if((a <= M_PI && b >= M_PI) || b >= 3*M_PI) rlo = -1;
+        if(b >= twoPi) rhi = 1;
+        lo = float(rlo); hi = float(rhi);
+        Widen(lo, hi);
+        lo = Max(lo, -1); hi = Min(hi, 1);
+    }
+
+    // x^n for an integral exponent n
+    inline void IntervalIntPow(float alo, float ahi, int n,
+                               float& lo, float& hi)
+    {
+        if(n == 0) { lo = hi = 1; return; }
+        if(n < 0 && alo <= 0 && ahi >= 0) { Unbounded(lo, hi); return; }
+        const float pl = pow(alo, float(n)), ph = pow(ahi, float(n));
+        if(n & 1)
+        {
+            // odd powers are monotonic on each side of 0
+            lo = Min(pl, ph); hi = Max(pl, ph);
+        }
+        else if(alo >= 0 || ahi <= 0)
+        {
+            lo = Min(pl, ph); hi = Max(pl, ph);
+        }
+        else
+        {
+            lo = 0; hi = Max(pl, ph);
+        }
+        Widen(lo, hi);
+        if(!(n & 1) && lo < 0) lo = 0;
+    }
+
+    // floatToInt(x) == 0 for every x in [lo,hi] ?
+    inline bool IntervalIsFalse(float lo, float hi)
+    {
+        return lo > -.5f && hi < .5f;
+    }
+    // floatToInt(x) != 0 for every x in [lo,hi] ?
+    inline bool IntervalIsTrue(float lo, float hi)
+    {
+        return lo >= .5f || hi <= -.5f;
+    }
+}
+
+void FunctionParser::EvalInterval(const float* LoVars, const float* HiVars,
+                                  float& Lo, float& Hi)
+{
+    vector<float> LoStack(data->StackSize+1), HiStack(data->StackSize+1);
+    bool MayFail = false;
+
+    evalErrorType=0;
+    if(EvalIntervalRange(0, data->ByteCodeSize, 0, -1, LoVars, HiVars,
+                         &LoStack[0], &HiStack[0], MayFail) < 0)
+    {
+        // every point of the box makes Eval() fail, hence return 0
+        Lo = Hi = 0;
+        return;
+    }
+
+    Lo = LoStack[0];
+    Hi = HiStack[0];
+    if(MayFail) { Lo = Min(Lo, 0); Hi = Max(Hi, 0); }
+}
+
+// Interval evaluation of ByteCode[IP..EndIP[, starting from immediate DP
+// and stack pointer SP. Returns the final stack pointer, or -2 if Eval()
+// fails for every point of the box.
+int FunctionParser::EvalIntervalRange(unsigned IP, unsigned EndIP,
+                                      unsigned DP, int SP,
+                                      const float* LoVars,
+                                      const float* HiVars,
+                                      float* Lo, float* Hi, bool& MayFail)
+{
+    const unsigned* const ByteCode = data->ByteCode;
+    const float* const Immed = data->Immed;
+
+    for(; IP<EndIP; ++IP)
+    {
+        float& lo = Lo[SP < 0 ? 0 : SP];
+        float& hi = Hi[SP < 0 ? 0 : SP];
+
+        switch(ByteCode[IP])
+        {
+// Functions:
+          case   cAbs:
+              if(lo >= 0) break;
+              if(hi <= 0) { const float t = -lo; lo = -hi; hi = t; break; }
+              hi = Max(-lo, hi); lo = 0; break;
+
+          case  cAcos:
+          case  cAsin:
+              if(hi < -1 || lo > 1) return -2;
+              if(lo < -1 || hi > 1) MayFail = true;
+              lo = Max(lo, -1); hi = Min(hi, 1);
+              if(ByteCode[IP] == cAcos)
+              { const float t = acos(hi); hi = acos(lo); lo = t; }
+              else
+              { lo = asin(lo); hi = asin(hi); }
+              Widen(lo, hi); break;
+#ifndef NO_ASINH
+          case cAcosh: lo = acosh(lo); hi = acosh(hi);
+                       Widen(lo, hi); break;
+          case cAsinh: lo = asinh(lo); hi = asinh(hi);
+                       Widen(lo, hi); break;
+          case cAtanh: lo = atanh(lo); hi = atanh(hi);
+                       Widen(lo, hi); break;
+#endif
+          case  cAtan: lo = atan(lo); hi = atan(hi); Widen(lo, hi); break;
+          case cAtan2: --SP;
+                       Lo[SP] = -float(M_PI); Hi[SP] = float(M_PI);
+                       Widen(Lo[SP], Hi[SP]); break;
+          case  cCeil: lo = ceil(lo); hi = ceil(hi); break;
+          case   cCos: IntervalCos(lo, hi); break;
+          case  cCosh:
+              {
+                  const float cl = cosh(lo), ch = cosh(hi);
+                  if(lo <= 0 && hi >= 0) { lo = 1; hi = Max(cl, ch); }
+                  else { lo = Min(cl, ch); hi = Max(cl, ch); }
+                  Widen(lo, hi); break;
+              }
+
+          case   cCot:
+          case   cCsc:
+          case   cSec:
+              // periodic poles: give up on bounding
+              MayFail = true; Unbounded(lo, hi); break;
+
+#ifndef DISABLE_EVAL
+          case  cEval:
+              {
+                  vector<float> SubLo(data->varAmount), SubHi(data->varAmount);
+                  for(int i=0; i<data->varAmount; ++i)
+                  {
+                      SubLo[i] = Lo[SP-data->varAmount+1+i];
+                      SubHi[i] = Hi[SP-data->varAmount+1+i];
+                  }
+                  SP -= data->varAmount-1;
+                  EvalInterval(&SubLo[0], &SubHi[0], Lo[SP], Hi[SP]);
+                  break;
+              }
+#endif
+
+          case   cExp: lo = exp(lo); hi = exp(hi); Widen(lo, hi); break;
+          case cFloor: lo = floor(lo); hi = floor(hi); break;
+
+          case    cIf:
+              {
+                  const unsigned jumpAddr = ByteCode[++IP];
+                  const unsigned immedAddr = ByteCode[++IP];
+                  const float clo = lo, chi = hi;
+                  --SP;
+                  if(IntervalIsFalse(clo, chi))
+                  {
+                      IP = jumpAddr;
+                      DP = immedAddr;
+                  }
+                  else if(!IntervalIsTrue(clo, chi))
+                  {
+                      // undecided: enclose both branches
+                      const unsigned jumpIP = jumpAddr-2;
+                      const unsigned endIP = ByteCode[jumpIP+1]+1;
+                      bool thenFail = false, elseFail = false;
+                      const int thenSP =
+                          EvalIntervalRange(IP+1, jumpIP, DP, SP,
+                                            LoVars, HiVars, Lo, Hi,
+                                            thenFail);
+                      const float tlo = Lo[thenSP < 0 ? 0 : thenSP];
+                      const float thi = Hi[thenSP < 0 ? 0 : thenSP];
+                      const int elseSP =
+                          EvalIntervalRange(jumpAddr+1, endIP, immedAddr, SP,
+                                            LoVars, HiVars, Lo, Hi,
+                                            elseFail);
+                      if(thenSP < 0 && elseSP < 0) return -2;
+                      if(thenSP < 0 || elseSP < 0) MayFail = true;
+                      SP = (elseSP < 0) ? thenSP : elseSP;
+                      if(elseSP < 0) { Lo[SP] = tlo; Hi[SP] = thi; }
+                      else if(thenSP >= 0)
+                      { Lo[SP] = Min(Lo[SP], tlo); Hi[SP] = Max(Hi[SP], thi); }
+                      MayFail = MayFail || thenFail || elseFail;
+                      IP = endIP-1;
+                      DP = ByteCode[jumpIP+2];
+                  }
+                  break;
+              }
+
+          case   cInt: lo = floor(lo+.5f); hi = floor(hi+.5f); break;
+          case   cLog:
+          case cLog10:
+              if(hi <= 0) return -2;
+              if(lo <= 0) { MayFail = true; lo = -IntervalInf; }
+              else lo = (ByteCode[IP] == cLog) ? log(lo) : log10(lo);
+              hi = (ByteCode[IP] == cLog) ? log(hi) : log10(hi);
+              Widen(lo, hi); break;
+          case   cMax: Lo[SP-1] = Max(Lo[SP-1], lo);
+                       Hi[SP-1] = Max(Hi[SP-1], hi); --SP; break;
+          case   cMin: Lo[SP-1] = Min(Lo[SP-1], lo);
+                       Hi[SP-1] = Min(Hi[SP-1], hi); --SP; break;
+          case   cSin:
+              lo -= float(M_PI/2); hi -= float(M_PI/2);
+              Widen(lo, hi); IntervalCos(lo, hi); break;
+          case  cSinh: lo = sinh(lo); hi = sinh(hi); Widen(lo, hi); break;
+          case  cSqrt:
+              if(hi < 0) return -2;
+              if(lo < 0) { MayFail = true; lo = 0; }
+              lo = sqrt(lo); hi = sqrt(hi); Widen(lo, hi); break;
+          case   cTan:
+              {
+                  // monotonic between two consecutive poles
+                  const double k = floor((lo + M_PI/2) / M_PI);
+                  if(hi + M_PI/2 < (k+1)*M_PI)
+                  { lo = tan(lo); hi = tan(hi); Widen(lo, hi); }
+                  else Unbounded(lo, hi);
+                  break;
+              }
+          case  cTanh: lo = tanh(lo); hi = tanh(hi); Widen(lo, hi); break;
+
+
+// Misc:
+          case cImmed: ++SP; Lo[SP] = Hi[SP] = Immed[DP++]; break;
+          case  cJump: DP = ByteCode[IP+2];
+                       IP = ByteCode[IP+1];
+                       break;
+
+// Operators:
+          case   cNeg: { const float t = -lo; lo = -hi; hi = t; break; }
+          case   cAdd: Lo[SP-1] += lo; Hi[SP-1] += hi; --SP; break;
+          case   cSub: Lo[SP-1] -= hi; Hi[SP-1] -= lo; --SP; break;
+          case   cMul: IntervalMul(Lo[SP-1], Hi[SP-1], lo, hi,
+                                   Lo[SP-1], Hi[SP-1]);
+                       --SP; break;
+          case   cDiv:
+              if(lo == 0 && hi == 0) return -2;
+              if(lo <= 0 && hi >= 0)
+              {
+                  MayFail = true; --SP; Unbounded(Lo[SP], Hi[SP]); break;
+              }
+              {
+                  const float p0 = Lo[SP-1]/lo, p1 = Lo[SP-1]/hi;
+                  const float p2 = Hi[SP-1]/lo, p3 = Hi[SP-1]/hi;
+                  --SP;
+                  Lo[SP] = Min(Min(p0, p1), Min(p2, p3));
+                  Hi[SP] = Max(Max(p0, p1), Max(p2, p3));
+              }
+              break;
+          case   cMod:
+              {
+                  // fmod has the sign of the dividend and |fmod| < |divisor|
+                  if(lo == 0 && hi == 0) return -2;
+                  if(lo <= 0 && hi >= 0) MayFail = true;
+                  const float d = Max(fabs(lo), fabs(hi));
+                  --SP;
+                  Lo[SP] = (Lo[SP] >= 0) ? 0 : Max(Lo[SP], -d);
+                  Hi[SP] = (Hi[SP] <= 0) ? 0 : Min(Hi[SP],  d);
+                  break;
+              }
+          case   cPow:
+              {
+                  const float alo = Lo[SP-1], ahi = Hi[SP-1];
+                  --SP;
+                  if(lo == hi && lo == floor(lo) && fabs(lo) < 1<<24)
+                      IntervalIntPow(alo, ahi, int(lo), Lo[SP], Hi[SP]);
+                  else if(alo > 0)
+                  {
+                      // monotonic in each argument: extrema at the corners
+                      const float p0 = pow(alo, lo), p1 = pow(alo, hi);
+                      const float p2 = pow(ahi, lo), p3 = pow(ahi, hi);
+                      Lo[SP] = Min(Min(p0, p1), Min(p2, p3));
+                      Hi[SP] = Max(Max(p0, p1), Max(p2, p3));
+                      Widen(Lo[SP], Hi[SP]);
+                      if(Lo[SP] < 0) Lo[SP] = 0;
+                  }
+                  else Unbounded(Lo[SP], Hi[SP]);
+                  break;
+              }
+
+          case cEqual:
+              {
+                  const bool dis = Hi[SP-1] < lo || Lo[SP-1] > hi;
+                  const bool same = Lo[SP-1] == Hi[SP-1] && lo == hi &&
+                      lo == Lo[SP-1];
+                  --SP;
+                  Lo[SP] = same ? 1.f : 0.f; Hi[SP] = dis ? 0.f : 1.f;
+                  break;
+              }
+          case  cLess:
+              {
+                  const bool yes = Hi[SP-1] < lo, no = Lo[SP-1] >= hi;
+                  --SP;
+                  Lo[SP] = yes ? 1.f : 0.f; Hi[SP] = no ? 0.f : 1.f;
+                  break;
+              }
+          case cGreater:
+              {
+                  const bool yes = Lo[SP-1] > hi, no = Hi[SP-1] <= lo;
+                  --SP;
+                  Lo[SP] = yes ? 1.f : 0.f; Hi[SP] = no ? 0.f : 1.f;
+                  break;
+              }
+          case   cAnd:
+          case    cOr:
+              {
+                  const bool at = IntervalIsTrue(Lo[SP-1], Hi[SP-1]);
+                  const bool af = IntervalIsFalse(Lo[SP-1], Hi[SP-1]);
+                  const bool bt = IntervalIsTrue(lo, hi);
+                  const bool bf = IntervalIsFalse(lo, hi);
+                  bool yes, no;
+                  if(ByteCode[IP] == cAnd) { yes = at && bt; no = af || bf; }
+                  else                     { yes = at || bt; no = af && bf; }
+                  --SP;
+                  Lo[SP] = yes ? 1.f : 0.f; Hi[SP] = no ? 0.f : 1.f;
+                  break;
+              }
+
+// Degrees-radians conversion:
+          case   cDeg: lo = RadiansToDegrees(lo); hi = RadiansToDegrees(hi);
+                       break;
+          case   cRad: lo = DegreesToRadians(lo); hi = DegreesToRadians(hi);
+                       break;
+
+// User-defined function calls:
+          case cFCall:
+              {
+                  // opaque function pointer: nothing can be said
+                  unsigned index = ByteCode[++IP];
+                  unsigned params = data->FuncPtrs[index].params;
+                  SP -= params-1;
+                  Unbounded(Lo[SP], Hi[SP]);
+                  break;
+              }
+
+          case cPCall:
+              {
+                  unsigned index = ByteCode[++IP];
+                  FunctionParser* sub = data->FuncParsers[index];
+                  unsigned params = sub->data->varAmount;
+                  SP -= params-1;
+                  vector<float> SubLo(Lo+SP, Lo+SP+params);
+                  vector<float> SubHi(Hi+SP, Hi+SP+params);
+                  sub->EvalInterval(&SubLo[0], &SubHi[0], Lo[SP], Hi[SP]);
+                  break;
+              }
+
+
+#ifdef SUPPORT_OPTIMIZER
+          case   cVar: break; // Paranoia. These should never exist
+          case   cDup: ++SP; Lo[SP] = lo; Hi[SP] = hi; break;
+          case   cInv:
+              if(lo == 0 && hi == 0) return -2;
+              if(lo <= 0 && hi >= 0) { MayFail = true; Unbounded(lo, hi); }
+              else { const float t = 1.0f/lo; lo = 1.0f/hi; hi = t; }
+              break;
+#endif
+
+// Variables:
+          default:
+              ++SP;
+              Lo[SP] = LoVars[ByteCode[IP]-VarBegin];
+              Hi[SP] = HiVars[ByteCode[IP]-VarBegin];
+        }
+
+        if(SP >= 0) Sanitize(Lo[SP], Hi[SP]);
+    }
+
+    return SP;
+}
+
+
+//---------------------------------------------------------------------------
+// Automatic differentiation
+//---------------------------------------------------------------------------
+//===========================================================================
+// Forward mode: each stack entry carries its value and its GradVars partial
+// derivatives, stored contiguously in GradStack.
+namespace
+{
+    const unsigned GradDim = FunctionParser::GradVars;
+
+    // chain rule for a unary function: d f(u) = f'(u) du
+    inline void GradScale(float* g, float factor)
+    {
+        for(unsigned d=0; d<GradDim; ++d) g[d] *= factor;
+    }
+
+    inline void GradZero(float* g)
+    {
+        for(unsigned d=0; d<GradDim; ++d) g[d] = 0;
+    }
+}
+
+float FunctionParser::EvalGradient(const float* Vars, float* Gradient)
+{
+    const unsigned* const ByteCode = data->ByteCode;
+    const float* const Immed = data->Immed;
+    float* const Stack = data->Stack;
+    float* const Grad = data->GradStack;
+    const unsigned ByteCodeSize = data->ByteCodeSize;
+    unsigned IP, DP=0;
+    int SP=-1;
+
+    // null gradient on the domain errors
+    GradZero(Gradient);
+    evalErrorType=0;
+
+    for(IP=0; IP<ByteCodeSize; ++IP)
+    {
+        // gradients of the top and second entries of the stack
+        float* const g  = Grad + GradDim*(SP > 0 ? SP   : 0);
+        float* const g1 = Grad + GradDim*(SP > 1 ? SP-1 : 0);
+
+        switch(ByteCode[IP])
+        {
+// Functions:
+          case   cAbs: if(Stack[SP] < 0) GradScale(g, -1);
+                       Stack[SP] = fabs(Stack[SP]); break;
+          case  cAcos: if(Stack[SP] < -1 || Stack[SP] > 1)
+                       { evalErrorType=4; return 0; }
+                       GradScale(g, -1/sqrt(1-Stack[SP]*Stack[SP]));
+                       Stack[SP] = acos(Stack[SP]); break;
+#ifndef NO_ASINH
+          case cAcosh: GradScale(g, 1/sqrt(Stack[SP]*Stack[SP]-1));
+                       Stack[SP] = acosh(Stack[SP]); break;
+#endif
+          case  cAsin: if(Stack[SP] < -1 || Stack[SP] > 1)
+                       { evalErrorType=4; return 0; }
+                       GradScale(g, 1/sqrt(1-Stack[SP]*Stack[SP]));
+                       Stack[SP] = asin(Stack[SP]); break;
+#ifndef NO_ASINH
+          case cAsinh: GradScale(g, 1/sqrt(Stack[SP]*Stack[SP]+1));
+                       Stack[SP] = asinh(Stack[SP]); break;
+#endif
+          case  cAtan: GradScale(g, 1/(1+Stack[SP]*Stack[SP]));
+                       Stack[SP] = atan(Stack[SP]); break;
+          case cAtan2:
+              {
+                  const float a = Stack[SP-1], b = Stack[SP];
+                  const float n = a*a + b*b;
+                  for(unsigned d=0; d<GradDim; ++d)
+                      g1[d] = (n == 0) ? 0 : (b*g1[d] - a*g[d]) / n;
+                  Stack[SP-1] = atan2(a, b);
+                  --SP; break;
+              }
+#ifndef NO_ASINH
+          case cAtanh: GradScale(g, 1/(1-Stack[SP]*Stack[SP]));
+                       Stack[SP] = atanh(Stack[SP]); break;
+#endif
+          case  cCeil: GradZero(g); Stack[SP] = ceil(Stack[SP]); break;
+          case   cCos: GradScale(g, -sin(Stack[SP]));
+                       Stack[SP] = cos(Stack[SP]); break;
+          case  cCosh: GradScale(g, sinh(Stack[SP]));
+                       Stack[SP] = cosh(Stack[SP]); break;
+
+          case   cCot:
+              {
+                  float t = tan(Stack[SP]);
+                  if(t == 0) { evalErrorType=1; return 0; }
+                  const float s = sin(Stack[SP]);
+                  GradScale(g, -1/(s*s));
+                  Stack[SP] = 1/t; break;
+              }
+          case   cCsc:
+              {
+                  float s = sin(Stack[SP]);
+                  if(s == 0) { evalErrorType=1; return 0; }
+                  GradScale(g, -cos(Stack[SP])/(s*s));
+                  Stack[SP] = 1/s; break;
+              }
+
+
+#ifndef DISABLE_EVAL
+          case  cEval:
+              {
+                  data->Stack = new float[data->StackSize];
+                  float retVal = Eval(&Stack[SP-data->varAmount+1]);
+                  delete[] data->Stack;
+                  data->Stack = Stack;
+                  SP -= data->varAmount-1;
+                  Stack[SP] = retVal;
+                  GradZero(Grad + GradDim*SP);
+                  break;
+              }
+#endif
+
+          case   cExp: Stack[SP] = exp(Stack[SP]);
+                       GradScale(g, Stack[SP]); break;
+          case cFloor: GradZero(g); Stack[SP] = floor(Stack[SP]); break;
+
+          case    cIf:
+              {
+                  unsigned jumpAddr = ByteCode[++IP];
+                  unsigned immedAddr = ByteCode[++IP];
+                  if(floatToInt(Stack[SP]) == 0)
+                  {
+                      IP = jumpAddr;
+                      DP = immedAddr;
+                  }
+                  --SP; break;
+              }
+
+          case   cInt: GradZero(g); Stack[SP] = floor(Stack[SP]+.5f); break;
+          case   cLog: if(Stack[SP] <= 0) { evalErrorType=3; return 0; }
+                       GradScale(g, 1/Stack[SP]);
+                       Stack[SP] = log(Stack[SP]); break;
+          case cLog10: if(Stack[SP] <= 0) { evalErrorType=3; return 0; }
+                       GradScale(g, (float)0.43429448190325176116/Stack[SP]);
+                       Stack[SP] = log10(Stack[SP]); break;
+          case   cMax: if(Stack[SP] > Stack[SP-1])
+                       for(unsigned d=0; d<GradDim; ++d) g1[d] = g[d];
+                       Stack[SP-1] = Max(Stack[SP-1], Stack[SP]);
+                       --SP; break;
+          case   cMin: if(Stack[SP] < Stack[SP-1])
+                       for(unsigned d=0; d<GradDim; ++d) g1[d] = g[d];
+                       Stack[SP-1] = Min(Stack[SP-1], Stack[SP]);
+                       --SP; break;
+          case   cSec:
+              {
+                  float c = cos(Stack[SP]);
+                  if(c == 0) { evalErrorType=1; return 0; }
+                  GradScale(g, sin(Stack[SP])/(c*c));
+                  Stack[SP] = 1/c; break;
+              }
+          case   cSin: GradScale(g, cos(Stack[SP]));
+                       Stack[SP] = sin(Stack[SP]); break;
+          case  cSinh: GradScale(g, cosh(Stack[SP]));
+                       Stack[SP] = sinh(Stack[SP]); break;
+          case  cSqrt: if(Stack[SP] < 0) { evalErrorType=2; return 0; }
+                       Stack[SP] = sqrt(Stack[SP]);
+                       if(Stack[SP] == 0) GradZero(g);
+                       else GradScale(g, .5f/Stack[SP]);
+                       break;
+          case   cTan: Stack[SP] = tan(Stack[SP]);
+                       GradScale(g, 1+Stack[SP]*Stack[SP]); break;
+          case  cTanh: Stack[SP] = tanh(Stack[SP]);
+                       GradScale(g, 1-Stack[SP]*Stack[SP]); break;
+
+
+// Misc:
+          case cImmed: Stack[++SP] = Immed[DP++];
+                       GradZero(Grad + GradDim*SP); break;
+          case  cJump: DP = ByteCode[IP+2];
+                       IP = ByteCode[IP+1];
+                       break;
+
+// Operators:
+          case   cNeg: Stack[SP] = -Stack[SP]; GradScale(g, -1); break;
+          case   cAdd: for(unsigned d=0; d<GradDim; ++d) g1[d] += g[d];
+                       Stack[SP-1] += Stack[SP]; --SP; break;
+          case   cSub: for(unsigned d=0; d<GradDim; ++d) g1[d] -= g[d];
+                       Stack[SP-1] -= Stack[SP]; --SP; break;
+          case   cMul: for(unsigned d=0; d<GradDim; ++d)
+                           g1[d] = g1[d]*Stack[SP] + Stack[SP-1]*g[d];
+                       Stack[SP-1] *= Stack[SP]; --SP; break;
+          case   cDiv: if(Stack[SP] == 0) { evalErrorType=1; return 0; }
+                       Stack[SP-1] /= Stack[SP];
+                       for(unsigned d=0; d<GradDim; ++d)
+                           g1[d] = (g1[d] - Stack[SP-1]*g[d]) / Stack[SP];
+                       --SP; break;
+          case   cMod: if(Stack[SP] == 0) { evalErrorType=1; return 0; }
+                       {
+                           // fmod(a,b) = a - trunc(a/b) b
+                           const float q = Stack[SP-1] / Stack[SP];
+                           const float n = q < 0 ? ceil(q) : floor(q);
+                           for(unsigned d=0; d<GradDim; ++d)
+                               g1[d] -= n*g[d];
+                       }
+                       Stack[SP-1] = fmod(Stack[SP-1], Stack[SP]);
+                       --SP; break;
+          case   cPow:
+              {
+                  const float a = Stack[SP-1], b = Stack[SP];
+                  const float p = pow(a, b);
+                  // d(a^b) = b a^(b-1) da + a^b ln(a) db
+                  const float da = (b == 0) ? 0 : b*pow(a, b-1);
+                  const float db = (a > 0) ? p*log(a) : 0;
+                  for(unsigned d=0; d<GradDim; ++d)
+                      g1[d] = da*g1[d] + db*g[d];
+                  Stack[SP-1] = p;
+                  --SP; break;
+              }
+
+          case cEqual: Stack[SP-1] = (Stack[SP-1] == Stack[SP]);
+                       GradZero(g1); --SP; break;
+          case  cLess: Stack[SP-1] = (Stack[SP-1] < Stack[SP]);
+                       GradZero(g1); --SP; break;
+          case cGreater: Stack[SP-1] = (Stack[SP-1] > Stack[SP]);
+                         GradZero(g1); --SP; break;
+          case   cAnd: Stack[SP-1] =
+                           (floatToInt(Stack[SP-1]) &&
+                            floatToInt(Stack[SP]));
+                       GradZero(g1); --SP; break;
+          case    cOr: Stack[SP-1] =
+                           (floatToInt(Stack[SP-1]) ||
+                            floatToInt(Stack[SP]));
+                       GradZero(g1); --SP; break;
+
+// Degrees-radians conversion:
+          case   cDeg: Stack[SP] = RadiansToDegrees(Stack[SP]);
+                       GradScale(g, RadiansToDegrees(1)); break;
+          case   cRad: Stack[SP] = DegreesToRadians(Stack[SP]);
+                       GradScale(g, DegreesToRadians(1)); break;
+
+// User-defined function calls:
+          case cFCall:
+              {
+                  unsigned index = ByteCode[++IP];
+                  unsigned params = data->FuncPtrs[index].params;
+                  float retVal =
+                      data->FuncPtrs[index].ptr(&Stack[SP-params+1]);
+                  SP -= params-1;
+                  Stack[SP] = retVal;
+                  GradZero(Grad + GradDim*SP);
+                  break;
+              }
+
+          case cPCall:
+              {
+                  unsigned index = ByteCode[++IP];
+                  unsigned params = data->FuncParsers[index]->data->varAmount;
+                  float retVal =
+                      data->FuncParsers[index]->Eval(&Stack[SP-params+1]);
+                  SP -= params-1;
+                  Stack[SP] = retVal;
+                  GradZero(Grad + GradDim*SP);
+                  break;
+              }
+
+
+#ifdef SUPPORT_OPTIMIZER
+          case   cVar: break; // Paranoia. These should never exist
+          case   cDup: Stack[SP+1] = Stack[SP];
+                       for(unsigned d=0; d<GradDim; ++d)
+                           g[GradDim+d] = g[d];
+                       ++SP; break;
+          case   cInv:
+              if(Stack[SP] == 0.0) { evalErrorType=1; return 0; }
+              Stack[SP] = 1.0f/Stack[SP];
+              GradScale(g, -Stack[SP]*Stack[SP]);
+              break;
+#endif
+
+// Variables:
+          default:
+              {
+                  const unsigned var = ByteCode[IP]-VarBegin;
+                  Stack[++SP] = Vars[var];
+                  float* const gv = Grad + GradDim*SP;
+                  for(unsigned d=0; d<GradDim; ++d) gv[d] = (d == var);
+              }
+        }
+    }
+
+    for(unsigned d=0; d<GradDim; ++d) Gradient[d] = Grad[d];
+    evalErrorType=0;
+    return Stack[SP];
+}
+
+
 namespace
 {
     inline void printHex(std::ostream& dest, unsigned n)
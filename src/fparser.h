@@ -38,6 +38,19 @@ public:
     float Eval(const float* Vars);
     inline int EvalError() const { return evalErrorType; }
 
+    // Interval evaluation: stores in [Lo,Hi] an enclosure of every value
+    // Eval() can return while each variable i ranges over
+    // [LoVars[i],HiVars[i]]. Eval() failures count as a result of 0.
+    void EvalInterval(const float* LoVars, const float* HiVars,
+                      float& Lo, float& Hi);
+
+    // Forward-mode automatic differentiation: returns Eval(Vars) and stores
+    // in Gradient its partial derivatives with respect to the first
+    // GradVars variables. User-defined functions are taken as constants.
+    // On an evaluation error, EvalError() is set and Gradient is null.
+    enum { GradVars = 3 };
+    float EvalGradient(const float* Vars, float* Gradient);
+
     bool AddConstant(const std::string& name, float value);
 
     typedef float (*FunctionPtr)(const float*);
@@ -104,6 +117,7 @@ private:
         float* Immed;
         unsigned ImmedSize;
         float* Stack;
+        float* GradStack;
         unsigned StackSize;
 
         Data();
@@ -150,6 +164,9 @@ private:
     int CompileOr(const char*, int);
     int CompileExpression(const char*, int, bool=false);
 
+    int EvalIntervalRange(unsigned, unsigned, unsigned, int,
+                          const float*, const float*, float*, float*, bool&);
+
 
     void MakeTree(void*) const;
 };
@@ -0,0 +1,231 @@
+/**
+ * @file    glui_cmdline.cpp
+ * @author  Thomas Lewiner <thomas.lewiner@polytechnique.org>
+ * @author  Math Dept, PUC-Rio
+ * @version 0.3
+ * @date    30/05/2006
+ *
+ * @brief   MarchingCubes Graphical interface: command line
+ */
+//________________________________________________
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "csg.h"
+#include "iso_volume.h"
+#include "glui_defs.h"
+
+#ifdef _MSC_VER
+#define strcasecmp _stricmp
+#endif // _MSC_VER
+
+
+//_____________________________________________________________________________
+// usage of the command line
+static void print_usage( const char *prog )
+//-----------------------------------------------------------------------------
+{
+  printf( "usage : %s [input] [grid] [extraction] [output]\n", prog ) ;
+  printf( "input, the implicit function being evaluated at x,y,z with c the CSG tree and i the volume :\n" ) ;
+  printf( "  -formula f          implicit formula\n" ) ;
+  printf( "  -fun name|index     example function, for instance Sphere or 9 for the chair (default)\n" ) ;
+  printf( "  -csg file           CSG tree, the formula being c by default\n" ) ;
+  printf( "  -iso file           ISO volume, with its size and bounds, the formula being i by default\n" ) ;
+  printf( "  -raw file           raw volume of -size samples, x fastest, the formula being i by default\n" ) ;
+  printf( "  -dtype u8|i16|u16|f32|f64  type of the raw samples (f32)\n" ) ;
+  printf( "  -header n           bytes skipped at the start of the raw file (0)\n" ) ;
+  printf( "grid :\n" ) ;
+  printf( "  -res n              n samples along each axis (50)\n" ) ;
+  printf( "  -size nx ny nz      samples along each axis\n" ) ;
+  printf( "  -bounds xmin xmax ymin ymax zmin zmax  extent of the grid (-1 1 -1 1 -1 1)\n" ) ;
+  printf( "extraction :\n" ) ;
+  printf( "  -isoval v[,v...]    isovalues, one mesh each (0)\n" ) ;
+  printf( "  -original           original Marching Cubes instead of the topological one\n" ) ;
+  printf( "  -threads n          tesselation by bricks on n threads\n" ) ;
+  printf( "  -procs n            tesselation by bricks on n worker processes\n" ) ;
+  printf( "  -adaptive [l]       sampling of the bricks crossing the isosurface only, bounded by interval evaluation\n" ) ;
+  printf( "                      or by l, a positive bound on the variation along one grid step\n" ) ;
+  printf( "  -tracking           surface tracking from sign changes along lines of the grid\n" ) ;
+  printf( "  -pipeline           sampling, tesselation and writing by slabs, streaming the mesh\n" ) ;
+  printf( "output :\n" ) ;
+  printf( "  -o file             mesh file, binary STL if its extension is .stl, binary PLY otherwise\n" ) ;
+  printf( "  -format ply|stl     format of the mesh file, whatever its extension\n" ) ;
+  printf( "  -export_iso file    ISO file of the whole grid, sampled in full, without -pipeline nor -procs\n" ) ;
+  printf( "  -trace file         Chrome trace of the runs\n" ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// copies a file name, false if it does not fit
+static bool copy_name( char *dst, const char *src, const char *option )
+//-----------------------------------------------------------------------------
+{
+  if( strlen( src ) >= 1024 )
+  {
+    printf( "parse_cmdline error : %s argument too long\n", option ) ;
+    return false ;
+  }
+  strcpy( dst, src ) ;
+  return true ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// Command Line
+bool parse_cmdline( int argc, char* argv[] )
+//-----------------------------------------------------------------------------
+{
+  const char *csg_file = NULL, *iso_file = NULL, *raw_file = NULL ;
+  IsoVolume::DType dtype = IsoVolume::F32 ;
+  size_t header = 0 ;
+  int    fmt    = -1 ;
+  formula[0] = '\0' ;
+  isovals.clear() ;
+
+  for( int a = 1 ; a < argc ; ++a )
+  {
+    const char *opt = argv[a] ;
+    // number of arguments left after the option
+    const int nargs = argc - 1 - a ;
+#define NEED( n ) if( nargs < (n) ) { printf( "parse_cmdline error : %s expects %d argument(s)\n", opt, (n) ) ;  return false ; }
+
+    if( !strcmp( opt, "-h" ) || !strcmp( opt, "-help" ) ) { print_usage( argv[0] ) ;  return false ; }
+    else if( !strcmp( opt, "-formula" ) ) { NEED(1) ;  if( !copy_name( formula, argv[++a], opt ) ) return false ; }
+    else if( !strcmp( opt, "-fun" ) )
+    {
+      NEED(1) ;
+      const char *f = argv[++a] ;
+      curr_string = -1 ;
+      for( int i = 1 ; i < NFUNS ; ++i )
+        if( !strcasecmp( f, fun_list[i] ) ) curr_string = i ;
+      if( curr_string < 0 && isdigit( f[0] ) ) curr_string = atoi( f ) ;
+      if( curr_string < 1 || curr_string >= NFUNS )
+      {
+        printf( "parse_cmdline error : unknown function %s, the functions are :\n", f ) ;
+        for( int i = 1 ; i < NFUNS ; ++i ) printf( "  %2d %s\n", i, fun_list[i] ) ;
+        return false ;
+      }
+    }
+    else if( !strcmp( opt, "-csg"    ) ) { NEED(1) ;  csg_file = argv[++a] ; }
+    else if( !strcmp( opt, "-iso"    ) ) { NEED(1) ;  iso_file = argv[++a] ;  raw_file = NULL ; }
+    else if( !strcmp( opt, "-raw"    ) ) { NEED(1) ;  raw_file = argv[++a] ;  iso_file = NULL ; }
+    else if( !strcmp( opt, "-header" ) ) { NEED(1) ;  header   = (size_t)atol( argv[++a] ) ; }
+    else if( !strcmp( opt, "-dtype"  ) )
+    {
+      NEED(1) ;
+      static const char *names[] = { "u8", "i16", "u16", "f32", "f64" } ;
+      const char *t = argv[++a] ;
+      int d = 0 ;
+      while( d < 5 && strcasecmp( t, names[d] ) ) ++d ;
+      if( d == 5 ) { printf( "parse_cmdline error : unknown sample type %s\n", t ) ;  return false ; }
+      dtype = (IsoVolume::DType)d ;
+    }
+    else if( !strcmp( opt, "-res"    ) ) { NEED(1) ;  size_x = size_y = size_z = atoi( argv[++a] ) ; }
+    else if( !strcmp( opt, "-size"   ) ) { NEED(3) ;  size_x = atoi( argv[++a] ) ;  size_y = atoi( argv[++a] ) ;  size_z = atoi( argv[++a] ) ; }
+    else if( !strcmp( opt, "-bounds" ) )
+    {
+      NEED(6) ;
+      xmin = (float)atof( argv[++a] ) ;  xmax = (float)atof( argv[++a] ) ;
+      ymin = (float)atof( argv[++a] ) ;  ymax = (float)atof( argv[++a] ) ;
+      zmin = (float)atof( argv[++a] ) ;  zmax = (float)atof( argv[++a] ) ;
+    }
+    else if( !strcmp( opt, "-isoval" ) )
+    {
+      NEED(1) ;
+      for( const char *p = argv[++a] ; *p ; )
+      {
+        char *end ;
+        isovals.push_back( (float)strtod( p, &end ) ) ;
+        if( end == p || ( *end && *end != ',' ) ) { printf( "parse_cmdline error : invalid isovalues %s\n", argv[a] ) ;  return false ; }
+        p = *end ? end + 1 : end ;
+      }
+    }
+    else if( !strcmp( opt, "-original" ) ) originalMC = 1 ;
+    else if( !strcmp( opt, "-threads"  ) ) { NEED(1) ;  nthreads = atoi( argv[++a] ) ; }
+    else if( !strcmp( opt, "-procs"    ) ) { NEED(1) ;  nprocs   = atoi( argv[++a] ) ; }
+    else if( !strcmp( opt, "-adaptive" ) )
+    {
+      adaptive = 1 ;
+      if( nargs >= 1 && ( isdigit( argv[a+1][0] ) || argv[a+1][0] == '.' ) ) lipschitz = (float)atof( argv[++a] ) ;
+    }
+    else if( !strcmp( opt, "-tracking" ) ) tracking  = 1 ;
+    else if( !strcmp( opt, "-pipeline" ) ) pipelined = 1 ;
+    else if( !strcmp( opt, "-o"        ) ) { NEED(1) ;  if( !copy_name( mesh_out_filename, argv[++a], opt ) ) return false ; }
+    else if( !strcmp( opt, "-format"   ) )
+    {
+      NEED(1) ;
+      const char *f = argv[++a] ;
+      if     ( !strcasecmp( f, "ply" ) ) fmt = 0 ;
+      else if( !strcasecmp( f, "stl" ) ) fmt = 1 ;
+      else { printf( "parse_cmdline error : unknown mesh format %s\n", f ) ;  return false ; }
+    }
+    else if( !strcmp( opt, "-export_iso" ) ) { NEED(1) ;  if( !copy_name( iso_out_filename, argv[++a], opt ) ) return false ;  export_iso = 1 ; }
+    else if( !strcmp( opt, "-trace"      ) ) { NEED(1) ;  if( !copy_name( trace_filename  , argv[++a], opt ) ) return false ; }
+    else
+    {
+      printf( "parse_cmdline error : unknown option %s\n", opt ) ;
+      print_usage( argv[0] ) ;
+      return false ;
+    }
+#undef NEED
+  }
+
+  // grid
+  if( size_x < 2 || size_y < 2 || size_z < 2 )
+  {
+    printf( "parse_cmdline error : the grid needs at least 2 samples along each axis\n" ) ;
+    return false ;
+  }
+  if( nthreads < 1 ) nthreads = 1 ;
+  if( nprocs   < 1 ) nprocs   = 1 ;
+  if( isovals.empty() ) isovals.push_back( isoval ) ;
+
+  // mesh format from the extension, unless given
+  const size_t len = strlen( mesh_out_filename ) ;
+  if( fmt < 0 ) fmt = ( len > 4 && !strcasecmp( mesh_out_filename + len - 4, ".stl" ) ) ? 1 : 0 ;
+  mesh_stl = fmt ;
+
+  // the ISO file holds the samples of the whole grid, which the streamed and distributed extractions never hold
+  if( export_iso && ( nprocs > 1 || ( pipelined && len > 0 ) ) )
+  {
+    printf( "parse_cmdline error : -export_iso needs the whole grid, not -pipeline nor -procs\n" ) ;
+    return false ;
+  }
+
+  // CSG tree
+  if( csg_file )
+  {
+    FILE *fp = fopen( csg_file, "r" ) ;
+    if( !fp ) { printf( "parse_cmdline error : cannot open %s\n", csg_file ) ;  return false ; }
+    delete csg_root ;
+    csg_root = CSG_Node::parse( fp ) ;
+    fclose( fp ) ;
+    if( strlen( formula ) <= 0 && curr_string < 1 ) strcpy( formula, "c" ) ;
+  }
+
+  // volume, its grid replacing the size and bounds
+  if( iso_file || raw_file )
+  {
+    delete isovol ;
+    isovol = new IsoVolume ;
+    const int   size  [3] = { size_x, size_y, size_z } ;
+    const float bounds[6] = { xmin, xmax, ymin, ymax, zmin, zmax } ;
+    if( iso_file ? !isovol->open( iso_file ) : !isovol->open_raw( raw_file, size, dtype, bounds, header ) )
+    {
+      delete isovol ;
+      isovol = NULL ;
+      return false ;
+    }
+    if( strlen( formula ) <= 0 && curr_string < 1 ) strcpy( formula, "i" ) ;
+  }
+
+  return true ;
+}
+//_____________________________________________________________________________
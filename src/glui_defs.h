@@ -22,6 +22,8 @@
 #include <stdio.h>   // i/o functions
 #include "MarchingCubes.h"
 
+class IsoVolume ;
+
 
 #ifdef _DEBUG
 #define PRINT_GL_DEBUG  { if( ::glGetError() != GL_NO_ERROR ) printf( "openGL watch at line %d: %s\n", __LINE__, ::gluErrorString( ::glGetError() ) ) ; }
@@ -54,10 +56,27 @@ class CSG_Node ;
 
   /// isovalue defining the isosurface
   extern float isoval ;
+  /// isovalues of the command line, one mesh per isovalue
+  extern std::vector<float> isovals ;
 
   /// original/topological MC switch
   extern int   originalMC ;
 
+  /// coarse to fine sampling switch
+  extern int   adaptive ;
+  /// bound on the variation of the implicit function along one grid step, for the adaptive sampling, 0 to bound the
+  /// bricks by interval evaluation
+  extern float lipschitz ;
+
+  /// surface tracking switch
+  extern int   tracking ;
+
+  /// number of threads tesselating the grid by bricks
+  extern int   nthreads ;
+
+  /// number of worker processes tesselating the grid by bricks
+  extern int   nprocs ;
+
   /// grid left extension
   extern float xmin ;
   /// grid right extension
@@ -98,7 +117,7 @@ class CSG_Node ;
   extern float v[8] ;
 
   /// loaded iso grid
-  extern FILE        *isofile  ;
+  extern IsoVolume   *isovol   ;
 
   /// loaded CSG tree
   extern CSG_Node    *csg_root ;
@@ -113,14 +132,24 @@ bool run() ;
 /// Command Line
 bool parse_cmdline( int argc, char* argv[] ) ;
 
+  /// switch to export iso grid
+  extern int  export_iso ;
+  /// name of the exported iso grid
+  extern char iso_out_filename[1024] ;
+  /// switch to stream the mesh to mesh_out_filename while it is extracted
+  extern int  pipelined ;
+  /// name of the exported mesh
+  extern char mesh_out_filename[1024] ;
+  /// switch to export the mesh as binary STL rather than binary PLY
+  extern int  mesh_stl ;
+  /// name of the Chrome trace of the runs, no trace if empty
+  extern char trace_filename[1024] ;
+
 
 /*
 //-----------------------------------------------------------------------------
 // I/O functions
 
-  /// switch to export iso grid
-  extern int  export_iso ;
-
 /// set file extension of out_filename
 int  set_ext( const char ext[3] ) ;
 
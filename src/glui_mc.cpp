@@ -16,8 +16,16 @@
 
 #include <stdio.h>
 //#include "gl2ps.h"
+#include <vector>
+#include <algorithm>
 #include "csg.h"
+#include "csg_program.h"
 #include "fparser.h"
+#include "iso_volume.h"
+#include "pipeline.h"
+#include "brick_scheduler.h"
+#include "distributed.h"
+#include "trace.h"
 #include "glui_defs.h"
 
 
@@ -30,10 +38,27 @@ MarchingCubes mc ;
 
 // isovalue defining the isosurface
 float isoval = 0.0f ;
+// isovalues of the command line, one mesh per isovalue
+std::vector<float> isovals ;
 
 // original/topological MC switch
 int   originalMC = 0 ;
 
+// coarse to fine sampling switch
+int   adaptive = 0 ;
+// bound on the variation of the implicit function along one grid step, for the adaptive sampling, 0 to bound the
+// bricks by interval evaluation
+float lipschitz = 0.0f ;
+
+// surface tracking switch : only the cubes connected to the isosurface found along lines of the grid are visited
+int   tracking = 0 ;
+
+// number of threads tesselating the grid by bricks
+int   nthreads = 1 ;
+
+// number of worker processes tesselating the grid by bricks, sampled brick by brick without the whole grid in memory
+int   nprocs = 1 ;
+
 // grid extension
 float xmin=-1.0f, xmax=1.0f,  ymin=-1.0f, ymax=1.0f,  zmin=-1.0f, zmax=1.0f ;
 // grid size control
@@ -89,7 +114,7 @@ int   curr_string = -1 ;
 float v[8] ;
 
 // loaded iso grid
-FILE        *isofile  ;
+IsoVolume   *isovol = NULL ;
 
 // loaded CSG tree
 CSG_Node    *csg_root ;
@@ -105,6 +130,21 @@ bool run() ;
 // switch to export iso grid
 int  export_iso = 0 ;
 
+// name of the exported iso grid
+char iso_out_filename[1024] = "" ;
+
+// switch to stream the mesh to mesh_out_filename while it is extracted
+int  pipelined = 0 ;
+
+// name of the exported mesh
+char mesh_out_filename[1024] = "" ;
+
+// switch to export the mesh as binary STL rather than binary PLY
+int  mesh_stl = 0 ;
+
+// name of the Chrome trace of the runs, no trace if empty
+char trace_filename[1024] = "" ;
+
 // set file extension of out_filename
 int  set_ext( const char ext[3] ) ;
 
@@ -130,14 +170,33 @@ void export_tga() ;
 bool run()
 //-----------------------------------------------------------------------------
 {
-	strcpy(formula, fun_def[9]);
+  // chosen example function, the chair by default
+  if( strlen( formula ) <= 0 ) strcpy( formula, fun_def[ curr_string > 0 && curr_string < NFUNS ? curr_string : 9 ] ) ;
+
+  // spans of the whole run, dumped on any return
+  struct TraceDump { ~TraceDump() { if( strlen( trace_filename ) > 0 ) { Trace::enable( false ) ;  Trace::dump( trace_filename ) ; } } } trace_dump ;
+  if( strlen( trace_filename ) > 0 ) { Trace::clear() ;  Trace::enable() ; }
+  MC_TRACE_SPAN( "glui run" ) ;
 
   if( strlen(formula) <= 0 ) return false ;
-  //if( export_iso && strlen( out_filename->get_text() ) <= 0 ) export_iso = 0 ;
+  if( export_iso && strlen( iso_out_filename ) <= 0 ) export_iso = 0 ;
 
-  // Init data
-  mc.set_resolution( size_x, size_y, size_z ) ;
-  mc.init_all() ;
+  // the ISO file holds the samples of the whole grid : not with the streamed nor the distributed extraction, and
+  // without skipping the bricks
+  if( export_iso && ( nprocs > 1 || ( pipelined && strlen( mesh_out_filename ) > 0 ) ) )
+  {
+    printf( "no ISO export : the pipeline and the worker processes do not hold the whole grid\n" ) ;
+    export_iso = 0 ;
+  }
+  if( export_iso && adaptive ) printf( "full sampling of the grid for the ISO export\n" ) ;
+
+  // Grid of the iso volume
+  if( isovol )
+  {
+    size_x = isovol->size(X) ;  size_y = isovol->size(Y) ;  size_z = isovol->size(Z) ;
+    const float *b = isovol->bounds() ;
+    xmin = b[0] ;  xmax = b[1] ;  ymin = b[2] ;  ymax = b[3] ;  zmin = b[4] ;  zmax = b[5] ;
+  }
 
   // Parse formula
   FunctionParser fparser ;
@@ -154,33 +213,126 @@ bool run()
   float rx = (xmax-xmin) / (size_x - 1) ;
   float ry = (ymax-ymin) / (size_y - 1) ;
   float rz = (zmax-zmin) / (size_z - 1) ;
-  unsigned char buf[sizeof(float)] ;
-  for( i = 0 ; i < size_x ; i++ )
+
+  // CSG tree flattened and sampled by x slabs, pruned on each part of the slab
+  CSG_Program csg_prog( csg_root ) ;
+  std::vector<float> col_z( size_z ), slab_csg( csg_root ? size_y * size_z : 0 ) ;
+  for( k = 0 ; k < size_z ; k++ ) col_z[k] = (float)k * rz  + zmin ;
+
+  std::vector<float> csg ;
+  SampleFunction sample = [&]( const glm::ivec3 &first, const glm::ivec3 &stride, const glm::ivec3 &n, float *res )
+  {
+    if( csg_root )
+    {
+      const float org [3] = { (float)first.x * rx  + xmin, (float)first.y * ry  + ymin, (float)first.z * rz  + zmin } ;
+      const float step[3] = { stride.x * rx, stride.y * ry, stride.z * rz } ;
+      const int   m   [3] = { n.x, n.y, n.z } ;
+      csg.resize( n.x * n.y * n.z ) ;
+      csg_prog.sample( org, step, m, csg.data() ) ;
+    }
+
+    float pt[5] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f } ;
+    for( int k = 0 ; k < n.z ; k++ )
+    for( int j = 0 ; j < n.y ; j++ )
+    for( int i = 0 ; i < n.x ; i++ )
+    {
+      pt[X] = (float)( first.x + i * stride.x ) * rx  + xmin ;
+      pt[Y] = (float)( first.y + j * stride.y ) * ry  + ymin ;
+      pt[Z] = (float)( first.z + k * stride.z ) * rz  + zmin ;
+      if( csg_root ) pt[3] = csg[ k + n.z * ( j + n.y * i ) ] ;
+      if( isovol   ) pt[4] = isovol->value( first.x + i * stride.x, first.y + j * stride.y, first.z + k * stride.z ) ;
+      res[ i + n.x * ( j + n.y * k ) ] = fparser.Eval( pt ) - isoval ;
+    }
+  } ;
+
+  // Sampling, tesselation and writing by slabs, without the whole grid nor the mesh in memory
+  if( pipelined && strlen( mesh_out_filename ) > 0 )
+  {
+    MeshWriter   out ;
+    MeshPipeline pipe ;
+    if( !out.open( mesh_out_filename, mesh_stl ? MeshWriter::STL : MeshWriter::PLY ) ) return false ;
+    pipe.run( glm::ivec3( size_x, size_y, size_z ), sample, out, 0.0f, glm::vec3( xmin, ymin, zmin ), glm::vec3( rx, ry, rz ), originalMC == 1 ) ;
+    printf( "streamed %lu vertices and %lu triangles to %s\n", (unsigned long)pipe.nverts(), (unsigned long)pipe.ntrigs(), mesh_out_filename ) ;
+    return out.close() ;
+  }
+
+  // Bounds of the field minus the isovalue on a block of samples, from the ranges of the CSG tree and of the volume
+  RangeFunction range = [&]( const glm::ivec3 &lo, const glm::ivec3 &hi, float &vmin, float &vmax )
+  {
+    float plo[5] = { (float)lo.x * rx  + xmin, (float)lo.y * ry  + ymin, (float)lo.z * rz  + zmin, 0.0f, 0.0f } ;
+    float phi[5] = { (float)hi.x * rx  + xmin, (float)hi.y * ry  + ymin, (float)hi.z * rz  + zmin, 0.0f, 0.0f } ;
+    if( csg_root ) csg_prog.bound( plo, phi, plo[3], phi[3] ) ;
+    if( isovol   ) isovol->range( lo, hi, plo[4], phi[4] ) ;
+    fparser.EvalInterval( plo, phi, vmin, vmax ) ;
+    vmin -= isoval ;
+    vmax -= isoval ;
+  } ;
+
+  // Init data, the grid is not allocated for the worker processes
+  mc.set_resolution( size_x, size_y, size_z ) ;
+  if( nprocs <= 1 ) mc.init_all() ;
+
+  if( nprocs > 1 )
+    printf( "sampling by bricks for %d worker processes\n", nprocs ) ;
+  else if( adaptive && !export_iso )
+  {
+    if( lipschitz > 0.0f )
+    {
+      // coarse to fine, the bricks whose corners are farther from the isovalue than the bound allows are skipped by mc.run
+      int nskip = mc.sample_adaptive( sample, 0.0f, lipschitz ) ;
+      printf( "adaptive sampling with the bound %g skipped %d bricks\n", lipschitz, nskip ) ;
+    }
+    else
+    {
+      // bricks bounded by the interval evaluation of the formula, and by the ranges stored in the volume : only the
+      // bricks that may cross the isosurface are sampled, or decoded
+      const int brick = isovol && isovol->brick() > 0 ? isovol->brick() : 8 ;
+      int nskip = mc.sample_bounded( sample, range, 0.0f, 0.0f, brick ) ;
+      if( isovol ) printf( "bounded sampling skipped %d bricks, decoded %lu\n", nskip, (unsigned long)isovol->decoded() ) ;
+      else         printf( "bounded sampling skipped %d bricks\n", nskip ) ;
+    }
+  }
+  else
   {
-    val[X] = (float)i * rx  + xmin ;
-    for( j = 0 ; j < size_y ; j++ )
+    for( i = 0 ; i < size_x ; i++ )
     {
-      val[Y] = (float)j * ry  + ymin ;
-      for( k = 0 ; k < size_z ; k++ )
+      val[X] = (float)i * rx  + xmin ;
+      if( csg_root )
       {
-        val[Z] = (float)k * rz  + zmin ;
+        const float org [3] = { val[X], ymin, zmin } ;
+        const float step[3] = { rx, ry, rz } ;
+        const int   n   [3] = { 1, size_y, size_z } ;
+        csg_prog.sample( org, step, n, slab_csg.data() ) ;
+      }
 
-        if( csg_root )
-        {
-          val[3] = csg_root->eval( val[X],val[Y],val[Z] ) ;
-        }
-        if( isofile  )
+      for( j = 0 ; j < size_y ; j++ )
+      {
+        val[Y] = (float)j * ry  + ymin ;
+        for( k = 0 ; k < size_z ; k++ )
         {
-          fread (buf, sizeof(float), 1, isofile);
-          val[4] = * (float*) buf ;
+          val[Z] = col_z[k] ;
+
+          if( csg_root )
+          {
+            val[3] = slab_csg[ k + size_z * j ] ;
+          }
+          if( isovol   )
+          {
+            val[4] = isovol->value( i,j,k ) ;
+          }
+
+          w = fparser.Eval(val) - isoval ;
+          mc.set_data( w, i,j,k ) ;
         }
-
-        w = fparser.Eval(val) - isoval ;
-        mc.set_data( w, i,j,k ) ;
       }
     }
   }
-  //if( export_iso ) mc.writeISO( out_filename->get_text() ) ;
+  // the samples of the field itself, without the isovalue
+  if( export_iso )
+  {
+    const float bounds[6] = { xmin, xmax, ymin, ymax, zmin, zmax } ;
+    mc.writeISO( iso_out_filename, bounds, 32, isoval ) ;
+  }
 
 /*
   float data1[] = {0,3,1,-3,-3,-4,-1,-2,-4,-1,-3,-5,2,-1,-3,3,1,-1,-3,0,3,-3,1,2,0,-1,-1};
@@ -201,40 +353,65 @@ bool run()
   }
 */
 
-  // Run MC
-  mc.set_method( originalMC == 1 ) ;
-  mc.run() ;
-
-  // Rescale positions
-  for( i = 0 ; i < mc.nverts() ; ++i )
+  // Analytic normals, unless the field comes from the CSG tree or the iso grid
+  if( !fparser.using_var[3] && !fparser.using_var[4] )
   {
-    Vertex &v = mc.vertices()[i] ;
-    v.x = rx * v.x + xmin ;
-    v.y = ry * v.y + xmin ;
-    v.z = rz * v.z + ymin ;
-    float nrm = v.nx * v.nx + v.ny * v.ny + v.nz * v.nz ;
-    if( nrm != 0 )
+    mc.set_gradient( [&]( const glm::vec3 &p )
     {
-      nrm = 1.0 / sqrt(nrm) ;
-      v.nx *= nrm ;
-      v.ny *= nrm ;
-      v.nz *= nrm ;
-    }
+      float pt[5] = { p.x * rx + xmin, p.y * ry + ymin, p.z * rz + zmin, 0.0f, 0.0f } ;
+      float grad[FunctionParser::GradVars] ;
+      fparser.EvalGradient( pt, grad ) ;
+      if( fparser.EvalError() )
+      {
+        // domain error of the derivatives : central differences over one cell, no normal where the field fails too
+        const float h[3] = { rx, ry, rz } ;
+        for( int a = 0 ; a < 3 ; ++a )
+        {
+          float q[5] = { pt[0], pt[1], pt[2], 0.0f, 0.0f } ;
+          q[a] = pt[a] + h[a] ;
+          const float f1 = fparser.Eval( q ) ;
+          bool ok = !fparser.EvalError() ;
+          q[a] = pt[a] - h[a] ;
+          const float f0 = fparser.Eval( q ) ;
+          ok = ok && !fparser.EvalError() ;
+          grad[a] = ok ? ( f1 - f0 ) / ( 2 * h[a] ) : 0.0f ;
+        }
+      }
+      return glm::vec3( grad[X] * rx, grad[Y] * ry, grad[Z] * rz ) ;
+    } ) ;
   }
 
-  if( isofile )
+  // Run MC, the vertices being generated in world coordinates
+  mc.set_method( originalMC == 1 ) ;
+  mc.set_transform( glm::vec3( xmin, ymin, zmin ), glm::vec3( rx, ry, rz ) ) ;
+  if( nprocs > 1 )
+  {
+    DistributedExtractor extractor( nprocs ) ;
+    if( !extractor.run( mc, sample ) ) { mc.set_gradient() ;  return false ; }
+  }
+  else if( nthreads > 1 )
   {
-    rewind( isofile ) ;
-    fread (buf, sizeof(float), 1, isofile);
-    fread (buf, sizeof(float), 1, isofile);
-    fread (buf, sizeof(float), 1, isofile);
-    fread (buf, sizeof(float), 1, isofile);
-    fread (buf, sizeof(float), 1, isofile);
-    fread (buf, sizeof(float), 1, isofile);
-    fread (buf, sizeof(float), 1, isofile);
-    fread (buf, sizeof(float), 1, isofile);
-    fread (buf, sizeof(float), 1, isofile);
+    BrickExtractor extractor( nthreads ) ;
+    extractor.run( mc, 0.0f, range ) ;
   }
+  else if( tracking )
+    printf( "surface tracking visited %d cubes\n", mc.run_seeded() ) ;
+  else
+    mc.run() ;
+  mc.set_gradient() ;
+
+#if MC_STATS
+  const MCStats &st = mc.stats() ;
+  printf( "Marching Cubes ran in %f secs : signs %f, intersection %f, tesselation %f\n",
+          st.signs_secs + st.intersection_secs + st.tesselation_secs, st.signs_secs, st.intersection_secs, st.tesselation_secs ) ;
+  printf( "  %llu cubes, %llu face tests, %llu interior tests, %llu interior vertices, %llu bytes\n  cases",
+          (unsigned long long)st.cubes, (unsigned long long)st.face_tests, (unsigned long long)st.interior_tests,
+          (unsigned long long)st.c_vertices, (unsigned long long)st.bytes ) ;
+  for( i = 0 ; i < 15 ; ++i ) printf( " %llu", (unsigned long long)st.cases[i] ) ;
+  printf( "\n  13.1 %llu, 13.2 %llu, 13.3 %llu, 13.4 %llu, 13.5.1 %llu, 13.5.2 %llu\n",
+          (unsigned long long)st.subcases13[MCStats::S13_1], (unsigned long long)st.subcases13[MCStats::S13_2], (unsigned long long)st.subcases13[MCStats::S13_3],
+          (unsigned long long)st.subcases13[MCStats::S13_4], (unsigned long long)st.subcases13[MCStats::S13_5_1], (unsigned long long)st.subcases13[MCStats::S13_5_2] ) ;
+#endif // MC_STATS
 
 #if USE_GL_DISPLAY_LIST
   draw() ;
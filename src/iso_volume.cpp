@@ -0,0 +1,631 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// ISO volume
+// Bricked and compressed scalar grid mapped in memory
+//
+//________________________________________________
+
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <float.h>
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif // WIN32
+#include "iso_volume.h"
+#include "trace.h"
+
+// magic of the bricked format
+static const char   ISO_MAGIC[8] = { 'M', 'C', 'I', 'S', 'O', 'V', 'O', 'L' } ;
+// size of the header of the bricked format
+static const size_t ISO_HEADER   = 64 ;
+// size of the header of the former format
+static const size_t ISO_LEGACY   = 9 * 4 ;
+// size of an entry of the table
+static const size_t ISO_ENTRY    = 24 ;
+
+//_____________________________________________________________________________
+// copies n bytes, reversing them on big endian hosts
+static inline void copy_le( void *dst, const void *src, int n, bool swap )
+//-----------------------------------------------------------------------------
+{
+  if( !swap ) { memcpy( dst, src, n ) ; return ; }
+  for( int b = 0 ; b < n ; ++b ) ((char*)dst)[b] = ((const char*)src)[n-1-b] ;
+}
+//_____________________________________________________________________________
+
+//_____________________________________________________________________________
+// true on big endian hosts
+static inline bool big_endian()
+//-----------------------------------------------------------------------------
+{
+  const int one = 1 ;
+  return *(const char*)&one == 0 ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// size in bytes of a sample type
+int IsoVolume::dtype_size( DType dtype )
+//-----------------------------------------------------------------------------
+{
+  switch( dtype )
+  {
+  case U8   : return 1 ;
+  case I16   :
+  case U16  : return 2 ;
+  case F32 : return 4 ;
+  case F64 : return 8 ;
+  }
+  return 0 ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// converts the sample at p
+inline float IsoVolume::convert( const char *p ) const
+//-----------------------------------------------------------------------------
+{
+  switch( _dtype )
+  {
+  case U8   : return (float)*(const unsigned char*)p ;
+  case I16   : { int16_t  v ; copy_le( &v, p, 2, _swap ) ; return (float)v ; }
+  case U16  : { uint16_t v ; copy_le( &v, p, 2, _swap ) ; return (float)v ; }
+  case F32 : { float    v ; copy_le( &v, p, 4, _swap ) ; return v ; }
+  case F64 : { double   v ; copy_le( &v, p, 8, _swap ) ; return (float)v ; }
+  }
+  return 0.0f ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// maps a whole file
+bool IsoVolume::map_file( const char *fn )
+//-----------------------------------------------------------------------------
+{
+  close() ;
+  _swap = big_endian() ;
+
+#ifdef WIN32
+  printf( "IsoVolume::open error : no file mapping on this platform\n" ) ;
+  return false ;
+#else  // WIN32
+  const int fd = ::open( fn, O_RDONLY ) ;
+  if( fd < 0 )
+  {
+    printf( "IsoVolume::open error : cannot open %s\n", fn ) ;
+    return false ;
+  }
+  struct stat st ;
+  void *map = MAP_FAILED ;
+  if( fstat( fd, &st ) == 0 && st.st_size > 0 )
+    map = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 ) ;
+  ::close( fd ) ;
+  if( map == MAP_FAILED )
+  {
+    printf( "IsoVolume::open error : cannot map %s\n", fn ) ;
+    return false ;
+  }
+  _map = (const char*)map ;
+  _len = (size_t)st.st_size ;
+  return true ;
+#endif // WIN32
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// maps an ISO file
+bool IsoVolume::open( const char *fn )
+//-----------------------------------------------------------------------------
+{
+  MC_TRACE_SPAN( "IsoVolume::open" ) ;
+  if( !map_file( fn ) ) return false ;
+
+  bool ok = false ;
+  if( _len >= ISO_HEADER && !memcmp( _map, ISO_MAGIC, 8 ) )
+  {
+    uint32_t version, dtype ;
+    int32_t  size[3], brick ;
+    uint64_t table ;
+    copy_le( &version, _map +  8, 4, _swap ) ;
+    copy_le( &dtype  , _map + 12, 4, _swap ) ;
+    for( int a = 0 ; a < 3 ; ++a ) copy_le( size + a, _map + 16 + 4*a, 4, _swap ) ;
+    copy_le( &brick  , _map + 28, 4, _swap ) ;
+    for( int a = 0 ; a < 6 ; ++a ) copy_le( _bounds + a, _map + 32 + 4*a, 4, _swap ) ;
+    copy_le( &table  , _map + 56, 8, _swap ) ;
+
+    ok = ( version == 1 || version == 2 ) && dtype <= F64 && size[0] > 0 && size[1] > 0 && size[2] > 0 && brick > 0 ;
+    if( ok )
+    {
+      _dtype = (DType)dtype ;
+      _brick = brick ;
+      size_t nb = 1 ;
+      for( int a = 0 ; a < 3 ; ++a )
+      {
+        _size[a]    = size[a] ;
+        _nbricks[a] = ( size[a] + brick - 1 ) / brick ;
+        nb *= _nbricks[a] ;
+      }
+      const size_t entry = ( version == 1 ) ? 8 : ISO_ENTRY ;
+      ok = table <= _len && ( _len - table ) / entry >= nb + ( version == 1 ) ;
+      if( ok ) _table.resize( nb ) ;
+
+      // reads the table, every brick lying inside the file
+      const int ds = dtype_size( _dtype ) ;
+      for( int bk = 0 ; bk < _nbricks[2] && ok ; ++bk )
+      for( int bj = 0 ; bj < _nbricks[1] && ok ; ++bj )
+      for( int bi = 0 ; bi < _nbricks[0] && ok ; ++bi )
+      {
+        const size_t b = brick_index( bi, bj, bk ) ;
+        const size_t n = brick_samples( bi, bj, bk ) ;
+        const char  *e = _map + table + entry * b ;
+        Brick &br = _table[b] ;
+        copy_le( &br.offset, e, 8, _swap ) ;
+        if( version == 1 )
+        {
+          br.length = (uint32_t)( n * ds ) ;
+          br.codec  = RAW ;
+          br.vmin   = -FLT_MAX ;
+          br.vmax   =  FLT_MAX ;
+        }
+        else
+        {
+          copy_le( &br.length, e +  8, 4, _swap ) ;
+          copy_le( &br.codec , e + 12, 4, _swap ) ;
+          copy_le( &br.vmin  , e + 16, 4, _swap ) ;
+          copy_le( &br.vmax  , e + 20, 4, _swap ) ;
+        }
+        ok = br.offset <= _len && br.length <= _len - br.offset &&
+             ( ( br.codec == RAW && br.length == n * ds ) || ( br.codec == CONSTANT && br.length == 0 ) || br.codec == PACKED ) ;
+      }
+      if( ok ) _cache.resize( nb ) ;
+    }
+  }
+  else if( _len >= ISO_LEGACY )
+  {
+    // former format
+    int32_t size[3] ;
+    for( int a = 0 ; a < 3 ; ++a ) copy_le( size + a, _map + 4*a, 4, _swap ) ;
+    for( int a = 0 ; a < 6 ; ++a ) copy_le( _bounds + a, _map + 12 + 4*a, 4, _swap ) ;
+    ok = size[0] > 0 && size[1] > 0 && size[2] > 0 &&
+         _len == ISO_LEGACY + 4 * (size_t)size[0] * size[1] * size[2] ;
+    if( ok )
+    {
+      _legacy = true ;
+      _dtype  = F32 ;
+      _brick  = 0 ;
+      for( int a = 0 ; a < 3 ; ++a ) { _size[a] = size[a] ;  _nbricks[a] = 1 ; }
+    }
+  }
+
+  if( !ok )
+  {
+    printf( "IsoVolume::open error : %s is not a valid ISO file\n", fn ) ;
+    close() ;
+  }
+  return ok ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// maps a raw file
+bool IsoVolume::open_raw( const char *fn, const int size[3], DType dtype, const float bounds[6], size_t header )
+//-----------------------------------------------------------------------------
+{
+  MC_TRACE_SPAN( "IsoVolume::open_raw" ) ;
+  if( size[0] <= 0 || size[1] <= 0 || size[2] <= 0 || dtype_size( dtype ) == 0 )
+  {
+    printf( "IsoVolume::open_raw error : invalid size or type for %s\n", fn ) ;
+    return false ;
+  }
+  if( !map_file( fn ) ) return false ;
+
+  // one raw brick covering the grid, its samples in the order of the file
+  const size_t n = (size_t)size[0] * size[1] * size[2] * dtype_size( dtype ) ;
+  if( header > _len || _len - header < n )
+  {
+    printf( "IsoVolume::open_raw error : %s is too short for %dx%dx%d samples\n", fn, size[0], size[1], size[2] ) ;
+    close() ;
+    return false ;
+  }
+  _dtype = dtype ;
+  _brick = std::max( size[0], std::max( size[1], size[2] ) ) ;
+  for( int a = 0 ; a < 3 ; ++a ) { _size[a] = size[a] ;  _nbricks[a] = 1 ; }
+  for( int a = 0 ; a < 6 ; ++a ) _bounds[a] = bounds[a] ;
+  // the length of a raw brick follows from its samples, it is not limited to 32 bits here
+  Brick br = { header, 0, RAW, -FLT_MAX, FLT_MAX } ;
+  _table.assign( 1, br ) ;
+  _cache.resize( 1 ) ;
+  return true ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// unmaps the file
+void IsoVolume::close()
+//-----------------------------------------------------------------------------
+{
+#ifndef WIN32
+  if( _map ) munmap( (void*)_map, _len ) ;
+#endif // WIN32
+  _map    = NULL ;
+  _len    = 0 ;
+  _legacy = false ;
+  _brick  = 0 ;
+  _size[0] = _size[1] = _size[2] = 0 ;
+  _nbricks[0] = _nbricks[1] = _nbricks[2] = 0 ;
+  std::vector<Brick>().swap( _table ) ;
+  std::vector< std::vector<float> >().swap( _cache ) ;
+  _ndecoded = 0 ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// number of samples of a brick
+size_t IsoVolume::brick_samples( int bi, int bj, int bk ) const
+//-----------------------------------------------------------------------------
+{
+  const int B = _brick ;
+  return (size_t)std::min( B, _size[0] - bi*B ) * std::min( B, _size[1] - bj*B ) * std::min( B, _size[2] - bk*B ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// bounds of the samples of a brick
+void IsoVolume::brick_range( int bi, int bj, int bk, float &vmin, float &vmax ) const
+//-----------------------------------------------------------------------------
+{
+  if( _legacy ) { vmin = -FLT_MAX ;  vmax = FLT_MAX ;  return ; }
+  const Brick &br = _table[ brick_index( bi, bj, bk ) ] ;
+  vmin = br.vmin ;
+  vmax = br.vmax ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// bounds of the samples of a box
+void IsoVolume::range( const glm::ivec3 &lo, const glm::ivec3 &hi, float &vmin, float &vmax ) const
+//-----------------------------------------------------------------------------
+{
+  if( _legacy ) { vmin = -FLT_MAX ;  vmax = FLT_MAX ;  return ; }
+  const int B = _brick ;
+  vmin =  FLT_MAX ;
+  vmax = -FLT_MAX ;
+  for( int bk = lo.z / B ; bk <= hi.z / B ; ++bk )
+  for( int bj = lo.y / B ; bj <= hi.y / B ; ++bj )
+  for( int bi = lo.x / B ; bi <= hi.x / B ; ++bi )
+  {
+    const Brick &br = _table[ brick_index( bi, bj, bk ) ] ;
+    vmin = std::min( vmin, br.vmin ) ;
+    vmax = std::max( vmax, br.vmax ) ;
+  }
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// value of the sample (i,j,k)
+float IsoVolume::value( int i, int j, int k ) const
+//-----------------------------------------------------------------------------
+{
+  if( _legacy )
+    return convert( _map + ISO_LEGACY + 4 * ( (size_t)k + _size[2] * ( (size_t)j + (size_t)_size[1] * i ) ) ) ;
+
+  const int B  = _brick ;
+  const int bi = i / B, bj = j / B, bk = k / B ;
+  const int ex = std::min( B, _size[0] - bi*B ), ey = std::min( B, _size[1] - bj*B ) ;
+  const size_t b = brick_index( bi, bj, bk ) ;
+  const size_t s = ( i - bi*B ) + ex * ( ( j - bj*B ) + (size_t)ey * ( k - bk*B ) ) ;
+  const Brick &br = _table[b] ;
+  switch( br.codec )
+  {
+  case CONSTANT : return br.vmin ;
+  case PACKED   : return decode( b, brick_samples( bi, bj, bk ) )[s] ;
+  default       : return convert( _map + br.offset + s * dtype_size( _dtype ) ) ;
+  }
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// converts the samples of a brick to floats
+void IsoVolume::read_brick( int bi, int bj, int bk, float *res ) const
+//-----------------------------------------------------------------------------
+{
+  if( _legacy )
+  {
+    for( int k = 0 ; k < _size[2] ; ++k )
+    for( int j = 0 ; j < _size[1] ; ++j )
+    for( int i = 0 ; i < _size[0] ; ++i )
+      res[ i + _size[0] * ( j + (size_t)_size[1] * k ) ] = value( i, j, k ) ;
+    return ;
+  }
+
+  const size_t b  = brick_index( bi, bj, bk ) ;
+  const size_t n  = brick_samples( bi, bj, bk ) ;
+  const int    ds = dtype_size( _dtype ) ;
+  const Brick &br = _table[b] ;
+  const char  *p  = _map + br.offset ;
+  if( br.codec == CONSTANT )
+    std::fill( res, res + n, br.vmin ) ;
+  else if( br.codec == PACKED )
+  {
+    if( !_cache[b].empty() ) std::copy( _cache[b].begin(), _cache[b].end(), res ) ;
+    else if( !unpack( b, n, res ) ) std::fill( res, res + n, 0.0f ) ;
+  }
+  else if( _dtype == F32 && !_swap )
+    memcpy( res, p, n * sizeof(float) ) ;
+  else
+    for( size_t s = 0 ; s < n ; ++s, p += ds ) res[s] = convert( p ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// samples a regular block of the grid
+void IsoVolume::sample( const glm::ivec3 &first, const glm::ivec3 &stride, const glm::ivec3 &n, float *res ) const
+//-----------------------------------------------------------------------------
+{
+  for( int k = 0 ; k < n.z ; ++k )
+  for( int j = 0 ; j < n.y ; ++j )
+  for( int i = 0 ; i < n.x ; ++i )
+    res[ i + n.x * ( j + n.y * k ) ] = value( first.x + i*stride.x, first.y + j*stride.y, first.z + k*stride.z ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// converts the samples of a compressed brick
+bool IsoVolume::unpack( size_t b, size_t n, float *res ) const
+//-----------------------------------------------------------------------------
+{
+  const int ds = dtype_size( _dtype ) ;
+  const Brick &br = _table[b] ;
+  std::vector<char> bytes( n * ds ) ;
+  if( !unpack_bytes( _map + br.offset, br.length, n, ds, bytes.data() ) )
+  {
+    printf( "IsoVolume::unpack error : corrupted brick %lu\n", (unsigned long)b ) ;
+    return false ;
+  }
+  const char *p = bytes.data() ;
+  for( size_t s = 0 ; s < n ; ++s, p += ds ) res[s] = convert( p ) ;
+  ++_ndecoded ;
+  return true ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// samples of a compressed brick, decoded on the first access
+const float *IsoVolume::decode( size_t b, size_t n ) const
+//-----------------------------------------------------------------------------
+{
+  std::vector<float> &c = _cache[b] ;
+  if( c.empty() )
+  {
+    c.resize( n ) ;
+    if( !unpack( b, n, c.data() ) ) std::fill( c.begin(), c.end(), 0.0f ) ;
+  }
+  return c.data() ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// shuffles the samples by planes and run length encodes them
+void IsoVolume::pack_bytes( const char *src, size_t n, int ds, std::vector<char> &dst )
+//-----------------------------------------------------------------------------
+{
+  std::vector<unsigned char> planes( n * ds ) ;
+  for( int c = 0 ; c < ds ; ++c )
+    for( size_t s = 0 ; s < n ; ++s ) planes[ c*n + s ] = src[ s*ds + c ] ;
+
+  dst.clear() ;
+  const size_t len = planes.size() ;
+  size_t lit = 0 ;  // first pending literal
+  size_t p   = 0 ;
+  while( p < len )
+  {
+    size_t run = 1 ;
+    while( p + run < len && run < 130 && planes[p+run] == planes[p] ) ++run ;
+    if( run < 3 && p + run < len ) { p += run ;  continue ; }
+    if( run < 3 ) p += run ;
+
+    // flushes the literals before the run, by blocks of 128
+    for( ; lit < p ; )
+    {
+      const size_t m = std::min( (size_t)128, p - lit ) ;
+      dst.push_back( (char)( m - 1 ) ) ;
+      dst.insert( dst.end(), planes.begin() + lit, planes.begin() + lit + m ) ;
+      lit += m ;
+    }
+    if( run >= 3 )
+    {
+      dst.push_back( (char)( run + 125 ) ) ;
+      dst.push_back( (char)planes[p] ) ;
+      p  += run ;
+      lit = p ;
+    }
+  }
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// decodes the runs and unshuffles the planes
+bool IsoVolume::unpack_bytes( const char *src, size_t len, size_t n, int ds, char *dst )
+//-----------------------------------------------------------------------------
+{
+  const unsigned char *in  = (const unsigned char*)src ;
+  const unsigned char *end = in + len ;
+  const size_t total = n * ds ;
+  std::vector<char> planes( total ) ;
+  size_t p = 0 ;
+  while( in < end )
+  {
+    const unsigned c = *in++ ;
+    if( c < 128 )
+    {
+      const size_t m = c + 1 ;
+      if( (size_t)( end - in ) < m || total - p < m ) return false ;
+      memcpy( &planes[p], in, m ) ;
+      in += m ;  p += m ;
+    }
+    else
+    {
+      const size_t m = c - 125 ;
+      if( in == end || total - p < m ) return false ;
+      memset( &planes[p], *in++, m ) ;
+      p += m ;
+    }
+  }
+  if( p != total ) return false ;
+
+  for( int c = 0 ; c < ds ; ++c )
+    for( size_t s = 0 ; s < n ; ++s ) dst[ s*ds + c ] = planes[ c*n + s ] ;
+  return true ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// writes a grid in an ISO file
+bool IsoVolume::write( const char *fn, const float *data, const int size[3], const float bounds[6], int brick, DType dtype, bool packed, float offset )
+//-----------------------------------------------------------------------------
+{
+  MC_TRACE_SPAN( "IsoVolume::write" ) ;
+  if( size[0] <= 0 || size[1] <= 0 || size[2] <= 0 || brick <= 0 || dtype_size( dtype ) == 0 ) return false ;
+
+  FILE *fp = fopen( fn, "wb" ) ;
+  if( !fp )
+  {
+    printf( "IsoVolume::write error : cannot create %s\n", fn ) ;
+    return false ;
+  }
+
+  const bool swap = big_endian() ;
+  const int  ds   = dtype_size( dtype ) ;
+  int nb[3] ;
+  for( int a = 0 ; a < 3 ; ++a ) nb[a] = ( size[a] + brick - 1 ) / brick ;
+  const size_t nbricks = (size_t)nb[0] * nb[1] * nb[2] ;
+
+  // header
+  char head[ISO_HEADER] ;
+  memset( head, 0, sizeof(head) ) ;
+  memcpy( head, ISO_MAGIC, 8 ) ;
+  const uint32_t version = VERSION, type = dtype ;
+  const uint64_t table = ISO_HEADER ;
+  copy_le( head +  8, &version, 4, swap ) ;
+  copy_le( head + 12, &type   , 4, swap ) ;
+  for( int a = 0 ; a < 3 ; ++a ) copy_le( head + 16 + 4*a, size + a, 4, swap ) ;
+  copy_le( head + 28, &brick  , 4, swap ) ;
+  for( int a = 0 ; a < 6 ; ++a ) copy_le( head + 32 + 4*a, bounds + a, 4, swap ) ;
+  copy_le( head + 56, &table  , 8, swap ) ;
+
+  // the table is completed once the bricks are written
+  std::vector<char> entries( ISO_ENTRY * nbricks ) ;
+  bool ok = fwrite( head, 1, ISO_HEADER, fp ) == ISO_HEADER && fwrite( entries.data(), 1, entries.size(), fp ) == entries.size() ;
+  uint64_t pos = ISO_HEADER + entries.size() ;
+
+  // bricks
+  std::vector<char> raw( (size_t)brick * brick * brick * ds ), pack, pad( PAGE ) ;
+  for( int bk = 0, b = 0 ; bk < nb[2] && ok ; ++bk )
+  for( int bj = 0 ; bj < nb[1] && ok ; ++bj )
+  for( int bi = 0 ; bi < nb[0] && ok ; ++bi, ++b )
+  {
+    // converts the samples, as read back
+    const int i0 = bi*brick, j0 = bj*brick, k0 = bk*brick ;
+    const int i1 = std::min( i0 + brick, size[0] ), j1 = std::min( j0 + brick, size[1] ), k1 = std::min( k0 + brick, size[2] ) ;
+    float vmin = FLT_MAX, vmax = -FLT_MAX ;
+    char *p = raw.data() ;
+    for( int k = k0 ; k < k1 ; ++k )
+    for( int j = j0 ; j < j1 ; ++j )
+    for( int i = i0 ; i < i1 ; ++i, p += ds )
+    {
+      float v = data[ i + (size_t)size[0] * ( j + (size_t)size[1] * k ) ] + offset ;
+      switch( dtype )
+      {
+      case U8  : { const unsigned char w = (unsigned char)std::min( 255.0f, std::max( 0.0f, floorf( v + 0.5f ) ) ) ; *p = w ;  v = w ; } break ;
+      case I16 : { const int16_t  w = (int16_t )std::min( 32767.0f, std::max( -32768.0f, floorf( v + 0.5f ) ) ) ; copy_le( p, &w, 2, swap ) ;  v = w ; } break ;
+      case U16 : { const uint16_t w = (uint16_t)std::min( 65535.0f, std::max( 0.0f, floorf( v + 0.5f ) ) ) ; copy_le( p, &w, 2, swap ) ;  v = w ; } break ;
+      case F32 : copy_le( p, &v, 4, swap ) ; break ;
+      case F64 : { const double w = v ; copy_le( p, &w, 8, swap ) ; } break ;
+      }
+      vmin = std::min( vmin, v ) ;
+      vmax = std::max( vmax, v ) ;
+    }
+    const size_t n = ( p - raw.data() ) / ds ;
+
+    // constant bricks are elided, the others packed when it pays
+    uint32_t codec = RAW ;
+    const char *bytes = raw.data() ;
+    size_t len = n * ds ;
+    if( vmin == vmax ) { codec = CONSTANT ;  len = 0 ; }
+    else if( packed )
+    {
+      pack_bytes( raw.data(), n, ds, pack ) ;
+      if( pack.size() < len ) { codec = PACKED ;  bytes = pack.data() ;  len = pack.size() ; }
+    }
+
+    // the raw bricks of the uncompressed files start on a page
+    if( codec == RAW && !packed && pos % PAGE )
+    {
+      const size_t m = (size_t)( PAGE - pos % PAGE ) ;
+      ok = fwrite( pad.data(), 1, m, fp ) == m ;
+      pos += m ;
+    }
+
+    char *e = &entries[ ISO_ENTRY * b ] ;
+    const uint32_t length = (uint32_t)len ;
+    copy_le( e     , &pos   , 8, swap ) ;
+    copy_le( e +  8, &length, 4, swap ) ;
+    copy_le( e + 12, &codec , 4, swap ) ;
+    copy_le( e + 16, &vmin  , 4, swap ) ;
+    copy_le( e + 20, &vmax  , 4, swap ) ;
+
+    if( ok && len ) ok = fwrite( bytes, 1, len, fp ) == len ;
+    pos += len ;
+  }
+
+  // table
+  if( ok ) ok = fseek( fp, (long)ISO_HEADER, SEEK_SET ) == 0 && fwrite( entries.data(), 1, entries.size(), fp ) == entries.size() ;
+
+  if( fclose( fp ) != 0 ) ok = false ;
+  if( !ok ) printf( "IsoVolume::write error : cannot write %s\n", fn ) ;
+  return ok ;
+}
+//_____________________________________________________________________________
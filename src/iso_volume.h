@@ -0,0 +1,183 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// ISO volume
+// Bricked and compressed scalar grid mapped in memory
+//
+//________________________________________________
+
+
+#ifndef _ISO_VOLUME_H_
+#define _ISO_VOLUME_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "MarchingCubes.h"
+
+//_____________________________________________________________________________
+// ISO file layout, little endian
+//
+//   header   64 bytes : "MCISOVOL", version, dtype, size[3], brick, bounds[6], table offset
+//   table    per brick : uint64 offset, uint32 length, uint32 codec, float min, float max
+//   bricks   samples of each brick, x fastest then y then z, the bricks ordered the same way
+//
+// The bricks are brick^3 samples, truncated on the far sides of the grid. Their codec is
+//   RAW      the samples, starting on a page boundary in the uncompressed files
+//   CONSTANT nothing, all the samples being equal to min
+//   PACKED   the bytes of the samples shuffled by planes (all the first bytes, then all the
+//            second bytes...), then run length encoded : a control byte c < 128 is followed by
+//            c+1 literal bytes, a control byte c >= 128 by one byte repeated c-125 times
+//
+// Version 1 files have no codec : their table is (number of bricks + 1) uint64 offsets of
+// page aligned raw bricks, the last one being the end of the file.
+// Files without the magic are read as the former ISO format : sizes as 3 ints,
+// bounds as 6 floats, then the float samples with z fastest then y then x.
+//_____________________________________________________________________________
+
+
+//_____________________________________________________________________________
+// Bricked volume reader and writer
+/** \class IsoVolume
+  * \brief Scalar grid stored by bricks in an ISO file, mapped in memory so that only the bricks read are paged in.
+  * The compressed bricks are decoded on their first access and kept decoded until close : the accesses to a
+  * compressed volume are not thread safe.
+  */
+class IsoVolume
+//-----------------------------------------------------------------------------
+{
+//-----------------------------------------------------------------------------
+// Constructors
+public :
+  /** sample types */
+  enum DType { U8, I16, U16, F32, F64 } ;
+  /** brick encodings */
+  enum Codec { RAW, CONSTANT, PACKED } ;
+  /** file version */
+  enum { VERSION = 2 } ;
+  /** alignment of the bricks in the file */
+  enum { PAGE = 4096 } ;
+
+  IsoVolume() : _map(NULL), _len(0), _legacy(false), _swap(false), _dtype(F32), _brick(0), _ndecoded(0)
+  { _size[0] = _size[1] = _size[2] = 0 ;  _nbricks[0] = _nbricks[1] = _nbricks[2] = 0 ; }
+  ~IsoVolume() { close() ; }
+
+//-----------------------------------------------------------------------------
+// Accessors
+public :
+  /** true if a file is mapped */
+  inline bool  is_open() const { return _map != NULL ; }
+  /** number of samples along axis a */
+  inline int   size  ( int a ) const { return _size[a] ; }
+  /** edge of the bricks in samples, 0 for the former unbricked format */
+  inline int   brick () const { return _brick ; }
+  /** type of the samples */
+  inline DType dtype () const { return _dtype ; }
+  /** extent of the grid : xmin, xmax, ymin, ymax, zmin, zmax */
+  inline const float *bounds() const { return _bounds ; }
+
+  /** number of bricks along axis a */
+  inline int   bricks( int a ) const { return _nbricks[a] ; }
+  /** number of bricks decoded so far */
+  inline size_t decoded() const { return _ndecoded ; }
+
+  /** bounds of the samples of a brick, infinite for the version 1 and former files */
+  void brick_range( int bi, int bj, int bk, float &vmin, float &vmax ) const ;
+  /** bounds of the samples lo <= (i,j,k) <= hi from the bounds of the bricks, as a RangeFunction */
+  void range( const glm::ivec3 &lo, const glm::ivec3 &hi, float &vmin, float &vmax ) const ;
+
+  /** value of the sample (i,j,k) */
+  float value( int i, int j, int k ) const ;
+
+  /**
+   * converts the samples of a brick to floats
+   * \param res samples of the brick, x fastest, truncated on the far sides of the grid
+   */
+  void read_brick( int bi, int bj, int bk, float *res ) const ;
+
+  /** samples first + (i,j,k)*stride for 0 <= (i,j,k) < n, stored in res[ i + n.x*( j + n.y*k ) ], as a SampleFunction */
+  void sample( const glm::ivec3 &first, const glm::ivec3 &stride, const glm::ivec3 &n, float *res ) const ;
+
+//-----------------------------------------------------------------------------
+// Operations
+public :
+  /**
+   * maps an ISO file
+   * \param fn name of the ISO file
+   * \return false if the file could not be mapped or is invalid
+   */
+  bool open( const char *fn ) ;
+  /**
+   * maps a raw file of samples, x fastest then y then z, as a volume of one brick without range
+   * \param fn     name of the raw file
+   * \param size   number of samples along each axis
+   * \param dtype  type of the samples, little endian
+   * \param bounds extent of the grid : xmin, xmax, ymin, ymax, zmin, zmax
+   * \param header number of bytes skipped at the start of the file
+   * \return false if the file could not be mapped or is too short
+   */
+  bool open_raw( const char *fn, const int size[3], DType dtype, const float bounds[6], size_t header = 0 ) ;
+  /** unmaps the file */
+  void close() ;
+
+  /**
+   * writes a grid in an ISO file
+   * \param fn     name of the ISO file to create
+   * \param data   samples of the grid, x fastest then y then z
+   * \param size   number of samples along each axis
+   * \param bounds extent of the grid : xmin, xmax, ymin, ymax, zmin, zmax
+   * \param brick  edge of the bricks in samples
+   * \param dtype  type of the stored samples, the integer types are rounded and clamped
+   * \param packed compresses the bricks, otherwise only the constant bricks are elided
+   * \param offset value added to the samples, for instance the isovalue subtracted from a MarchingCubes grid
+   * \return false if the file could not be written
+   */
+  static bool write( const char *fn, const float *data, const int size[3], const float bounds[6],
+                     int brick = 32, DType dtype = F32, bool packed = true, float offset = 0.0f ) ;
+
+  /** size in bytes of a sample type */
+  static int dtype_size( DType dtype ) ;
+
+private :
+  /** maps the whole file fn, after closing the current one */
+  bool map_file( const char *fn ) ;
+  /** converts the sample at p */
+  float convert( const char *p ) const ;
+  /** index of a brick in the table */
+  inline size_t brick_index( int bi, int bj, int bk ) const { return bi + _nbricks[0] * ( bj + (size_t)_nbricks[1] * bk ) ; }
+  /** number of samples of a brick */
+  size_t brick_samples( int bi, int bj, int bk ) const ;
+  /** converts the samples of the compressed brick b, false if it is corrupted */
+  bool unpack( size_t b, size_t n, float *res ) const ;
+  /** samples of the compressed brick b, decoded on the first access */
+  const float *decode( size_t b, size_t n ) const ;
+
+  /** shuffles n samples of ds bytes by planes and run length encodes them */
+  static void pack_bytes( const char *src, size_t n, int ds, std::vector<char> &dst ) ;
+  /** decodes len bytes into n samples of ds bytes, false if they do not match */
+  static bool unpack_bytes( const char *src, size_t len, size_t n, int ds, char *dst ) ;
+
+  /** entry of the table */
+  struct Brick { uint64_t offset ; uint32_t length ; uint32_t codec ; float vmin, vmax ; } ;
+
+//-----------------------------------------------------------------------------
+// Elements
+private :
+  const char     *_map      ;  /**< mapped file */
+  size_t          _len      ;  /**< length of the mapped file */
+  bool            _legacy   ;  /**< former unbricked format */
+  bool            _swap     ;  /**< big endian host */
+  DType           _dtype    ;  /**< type of the samples */
+  int             _size[3]  ;  /**< number of samples along each axis */
+  int             _brick    ;  /**< edge of the bricks in samples */
+  int             _nbricks[3];  /**< number of bricks along each axis */
+  float           _bounds[6];  /**< extent of the grid */
+  std::vector<Brick> _table ;  /**< entries of the bricks */
+  mutable std::vector< std::vector<float> > _cache ;  /**< decoded compressed bricks */
+  mutable size_t  _ndecoded ;  /**< number of bricks decoded */
+};
+//_____________________________________________________________________________
+
+
+#endif // _ISO_VOLUME_H_
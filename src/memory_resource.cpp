@@ -0,0 +1,125 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// Memory resources
+// Pluggable sources of memory for the buffers of the extraction
+//
+//________________________________________________
+
+
+#include <stdlib.h>
+#include <cstddef>
+#include <stdint.h>
+#include <new>
+#include <algorithm>
+#include "memory_resource.h"
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif // _MSC_VER
+
+
+//_____________________________________________________________________________
+// Global heap
+/** \class HeapResource
+  * \brief malloc and free, over-aligned blocks being allocated apart
+  */
+class HeapResource : public MemoryResource
+//-----------------------------------------------------------------------------
+{
+public :
+  void *allocate( size_t bytes, size_t align )
+  {
+    void *p = NULL ;
+    if( align <= alignof(std::max_align_t) )
+      p = malloc( bytes ? bytes : 1 ) ;
+    else
+    {
+#ifdef _MSC_VER
+      p = _aligned_malloc( bytes ? bytes : 1, align ) ;
+#else  // _MSC_VER
+      if( posix_memalign( &p, align, bytes ? bytes : 1 ) != 0 ) p = NULL ;
+#endif // _MSC_VER
+    }
+    if( !p ) throw std::bad_alloc() ;
+    return p ;
+  }
+
+  void deallocate( void *p, size_t, size_t align )
+  {
+#ifdef _MSC_VER
+    if( align > alignof(std::max_align_t) ) { _aligned_free( p ) ;  return ; }
+#endif // _MSC_VER
+    (void)align ;
+    free( p ) ;
+  }
+};
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// default resource
+MemoryResource *MemoryResource::heap()
+//-----------------------------------------------------------------------------
+{
+  static HeapResource heap ;
+  return &heap ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// Constructor
+MonotonicArena::MonotonicArena( size_t chunk /*= 1 << 20*/, MemoryResource *upstream /*= NULL*/ ) :
+//-----------------------------------------------------------------------------
+  _upstream( upstream ? upstream : MemoryResource::heap() ),
+  _first( std::max( chunk, (size_t)64 ) ),
+  _next( _first ),
+  _cur( NULL ),
+  _end( NULL ),
+  _footprint( 0 )
+{}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// carves a block out of the last chunk
+void *MonotonicArena::allocate( size_t bytes, size_t align )
+//-----------------------------------------------------------------------------
+{
+  char *p = (char*)( ( (uintptr_t)_cur + align - 1 ) & ~(uintptr_t)( align - 1 ) ) ;
+  if( !_cur || p + bytes > _end )
+  {
+    // new chunk, large enough for the block
+    const size_t size = std::max( _next, bytes + align ) ;
+    Chunk c = { (char*)_upstream->allocate( size, alignof(std::max_align_t) ), size } ;
+    _chunks.push_back( c ) ;
+    _footprint += size ;
+    _next = 2 * _next ;
+    _cur  = c.p ;
+    _end  = c.p + size ;
+    p = (char*)( ( (uintptr_t)_cur + align - 1 ) & ~(uintptr_t)( align - 1 ) ) ;
+  }
+  _cur = p + bytes ;
+  return p ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// gives the chunks back, the next ones starting over from the first size
+void MonotonicArena::release()
+//-----------------------------------------------------------------------------
+{
+  for( const Chunk &c : _chunks ) _upstream->deallocate( c.p, c.size, alignof(std::max_align_t) ) ;
+  _chunks.clear() ;
+  _next = _first ;
+  _cur = _end = NULL ;
+  _footprint = 0 ;
+}
+//_____________________________________________________________________________
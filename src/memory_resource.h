@@ -0,0 +1,139 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// Memory resources
+// Pluggable sources of memory for the buffers of the extraction
+//
+//________________________________________________
+
+
+#ifndef _MEMORY_RESOURCE_H_
+#define _MEMORY_RESOURCE_H_
+
+#include <stddef.h>
+#include <vector>
+#include <type_traits>
+
+//_____________________________________________________________________________
+// Memory resource
+/** \class MemoryResource
+  * \brief Source of memory for the buffers of MarchingCubes, in the manner of std::pmr::memory_resource which the
+  * C++11 library does not provide : a resource can draw from an arena, a pool of huge pages or NUMA-local memory
+  * instead of the global heap. A resource given to an object must outlive it.
+  */
+class MemoryResource
+//-----------------------------------------------------------------------------
+{
+//-----------------------------------------------------------------------------
+// Constructors
+public :
+  virtual ~MemoryResource() {}
+
+//-----------------------------------------------------------------------------
+// Operations
+public :
+  /** allocates bytes aligned on align, a power of 2, throwing std::bad_alloc on failure */
+  virtual void *allocate  ( size_t bytes, size_t align ) = 0 ;
+  /** gives back a block of allocate, of the same size and alignment */
+  virtual void  deallocate( void *p, size_t bytes, size_t align ) = 0 ;
+
+  /** global heap, the default resource */
+  static MemoryResource *heap() ;
+};
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// Monotonic arena
+/** \class MonotonicArena
+  * \brief Resource carving the blocks out of large chunks of an upstream resource, the deallocations doing nothing :
+  * all the memory is given back at once by release or by the destructor. Not thread safe, one arena serving one
+  * thread.
+  */
+class MonotonicArena : public MemoryResource
+//-----------------------------------------------------------------------------
+{
+//-----------------------------------------------------------------------------
+// Constructors
+public :
+  /**
+   * constructor
+   * \param chunk    size of the first chunk, the next ones doubling
+   * \param upstream resource of the chunks, the heap if null
+   */
+  MonotonicArena( size_t chunk = 1 << 20, MemoryResource *upstream = NULL ) ;
+  /** destructor, releasing the chunks */
+  ~MonotonicArena() { release() ; }
+
+  MonotonicArena( const MonotonicArena & ) = delete ;
+  MonotonicArena &operator=( const MonotonicArena & ) = delete ;
+
+//-----------------------------------------------------------------------------
+// Operations
+public :
+  void *allocate  ( size_t bytes, size_t align ) ;
+  void  deallocate( void *, size_t, size_t ) {}
+
+  /** gives all the chunks back to the upstream resource, invalidating all the blocks, the next chunk being of the first size */
+  void release() ;
+
+  /** bytes taken from the upstream resource */
+  inline size_t footprint() const { return _footprint ; }
+
+//-----------------------------------------------------------------------------
+// Elements
+private :
+  /** chunk of the upstream resource */
+  struct Chunk { char *p ; size_t size ; } ;
+
+  MemoryResource    *_upstream  ;  /**< resource of the chunks */
+  std::vector<Chunk> _chunks    ;  /**< chunks taken from the upstream resource */
+  size_t             _first     ;  /**< size of the first chunk */
+  size_t             _next      ;  /**< size of the next chunk */
+  char              *_cur       ;  /**< first free byte of the last chunk */
+  char              *_end       ;  /**< end of the last chunk */
+  size_t             _footprint ;  /**< bytes of the chunks */
+};
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// Allocator
+/** \class ResourceAllocator
+  * \brief Standard allocator drawing from a MemoryResource, the heap by default, as std::pmr::polymorphic_allocator.
+  * The resource follows the buffers when they are moved or swapped, so that the memory of a buffer handed to another
+  * object is always given back to the resource it came from.
+  */
+template <class T> class ResourceAllocator
+//-----------------------------------------------------------------------------
+{
+public :
+  typedef T value_type ;
+  typedef std::true_type propagate_on_container_move_assignment ;
+  typedef std::true_type propagate_on_container_swap ;
+
+  ResourceAllocator( MemoryResource *r = NULL ) : _resource( r ? r : MemoryResource::heap() ) {}
+  template <class U> ResourceAllocator( const ResourceAllocator<U> &a ) : _resource( a.resource() ) {}
+
+  inline T   *allocate  ( size_t n )       { return (T*)_resource->allocate( n * sizeof(T), alignof(T) ) ; }
+  inline void deallocate( T *p, size_t n ) { _resource->deallocate( p, n * sizeof(T), alignof(T) ) ; }
+
+  /** resource of the allocations */
+  inline MemoryResource *resource() const { return _resource ; }
+
+private :
+  MemoryResource *_resource ;  /**< resource of the allocations */
+};
+
+template <class T, class U> inline bool operator==( const ResourceAllocator<T> &a, const ResourceAllocator<U> &b ) { return a.resource() == b.resource() ; }
+template <class T, class U> inline bool operator!=( const ResourceAllocator<T> &a, const ResourceAllocator<U> &b ) { return a.resource() != b.resource() ; }
+
+/** buffer of the extraction, drawing from a MemoryResource */
+template <class T> using MCBuffer = std::vector< T, ResourceAllocator<T> > ;
+//_____________________________________________________________________________
+
+
+#endif // _MEMORY_RESOURCE_H_
@@ -0,0 +1,619 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// Mesh input / output
+// Binary PLY and STL files written by large blocks
+//
+//________________________________________________
+
+
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <math.h>
+#include <string>
+#include <sstream>
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif // WIN32
+#include "mesh_io.h"
+#include "ply.h"
+#include "trace.h"
+
+//_____________________________________________________________________________
+// The vertices are stored as the PLY vertex element, 6 floats, so that on
+// little endian hosts they are written straight from the caller's array.
+// PLY faces are lists of 3 ints with an uchar count, STL facets are 50 bytes.
+//_____________________________________________________________________________
+
+// bytes of a PLY face
+static const size_t PLY_FACE  = 1 + 3 * sizeof(int) ;
+// bytes of a STL facet
+static const size_t STL_FACET = 12 * sizeof(float) + 2 ;
+// width of the element counts of the PLY header, completed by close
+static const int    PLY_COUNT = 10 ;
+
+//_____________________________________________________________________________
+// copies 4 bytes, reversing them on big endian hosts
+static inline void put32( char *dst, const void *src, bool swap )
+//-----------------------------------------------------------------------------
+{
+  const char *s = (const char*)src ;
+  if( swap ) { dst[0] = s[3] ;  dst[1] = s[2] ;  dst[2] = s[1] ;  dst[3] = s[0] ; }
+  else memcpy( dst, s, 4 ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// creates the file and writes its header
+bool MeshWriter::open( const char *fn, Format fmt )
+//-----------------------------------------------------------------------------
+{
+  close() ;
+
+  _fp = fopen( fn, "wb" ) ;
+  if( !_fp )
+  {
+    printf( "MeshWriter::open error : cannot create %s\n", fn ) ;
+    return false ;
+  }
+  setvbuf( _fp, NULL, _IONBF, 0 ) ;  // written by blocks of BUFFER bytes
+
+  const int one = 1 ;
+  _swap   = *(const char*)&one == 0 ;
+  _fmt    = fmt ;
+  _nv     = _nt = 0 ;
+  _error  = false ;
+  _buf.resize( BUFFER ) ;
+  _len    = 0 ;
+  _buf_fp = _fp ;
+  _pos.clear() ;
+
+  write_header( 0, 0 ) ;
+  return true ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// writes the header with the given element counts
+void MeshWriter::write_header( size_t nv, size_t nt )
+//-----------------------------------------------------------------------------
+{
+  if( _fmt == STL )
+  {
+    char head[80] ;
+    memset( head, ' ', sizeof(head) ) ;
+    memcpy( head, "binary STL, MarchingCubes", 25 ) ;
+    const unsigned int n = (unsigned int)nt ;
+    char count[4] ;
+    put32( count, &n, _swap ) ;
+    if( fwrite( head, 1, 80, _fp ) != 80 || fwrite( count, 1, 4, _fp ) != 4 ) _error = true ;
+    return ;
+  }
+
+  if( fprintf( _fp,
+               "ply\n"
+               "format binary_little_endian 1.0\n"
+               "comment MarchingCubes\n"
+               "element vertex %-*lu\n"
+               "property float x\n"
+               "property float y\n"
+               "property float z\n"
+               "property float nx\n"
+               "property float ny\n"
+               "property float nz\n"
+               "element face %-*lu\n"
+               "property list uchar int vertex_indices\n"
+               "end_header\n", PLY_COUNT, (unsigned long)nv, PLY_COUNT, (unsigned long)nt ) < 0 )
+    _error = true ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// appends vertices to the mesh
+void MeshWriter::add_vertices( const Vertex *v, size_t n )
+//-----------------------------------------------------------------------------
+{
+  if( !_fp || n == 0 ) return ;
+  put_vertices( v, n ) ;
+  _nv += n ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// appends triangles to the mesh
+void MeshWriter::add_triangles( const Triangle *t, size_t n )
+//-----------------------------------------------------------------------------
+{
+  if( !_fp || n == 0 ) return ;
+
+  FILE *fp = _fp ;
+  if( _fmt == PLY )
+  {
+    // the faces follow all the vertices in the file : all of them wait in the temporary file, copied by close
+    if( !_spill ) _spill = tmpfile() ;
+    if( !_spill )
+    {
+      printf( "MeshWriter::add_triangles error : cannot create a temporary file\n" ) ;
+      _error = true ;
+      return ;
+    }
+    fp = _spill ;
+  }
+
+  put_triangles( t, n, fp ) ;
+  _nt += n ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// packs the vertices in the buffer
+void MeshWriter::put_vertices( const Vertex *v, size_t n )
+//-----------------------------------------------------------------------------
+{
+  if( _fmt == STL )
+  {
+    // kept for the facets
+    const size_t p = _pos.size() ;
+    _pos.resize( p + 3*n ) ;
+    for( size_t i = 0 ; i < n ; ++i )
+    {
+      _pos[p + 3*i  ] = v[i].x ;
+      _pos[p + 3*i+1] = v[i].y ;
+      _pos[p + 3*i+2] = v[i].z ;
+    }
+    return ;
+  }
+
+  if( !_swap && sizeof(Vertex) == 6 * sizeof(float) )
+  {
+    // already in the file layout
+    flush() ;
+    if( fwrite( v, sizeof(Vertex), n, _fp ) != n ) _error = true ;
+    return ;
+  }
+
+  for( size_t i = 0 ; i < n ; ++i )
+  {
+    char *dst = reserve( 6 * sizeof(float), _fp ) ;
+    put32( dst     , &v[i].x , _swap ) ;
+    put32( dst +  4, &v[i].y , _swap ) ;
+    put32( dst +  8, &v[i].z , _swap ) ;
+    put32( dst + 12, &v[i].nx, _swap ) ;
+    put32( dst + 16, &v[i].ny, _swap ) ;
+    put32( dst + 20, &v[i].nz, _swap ) ;
+  }
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// packs the triangles in the buffer of fp
+void MeshWriter::put_triangles( const Triangle *t, size_t n, FILE *fp )
+//-----------------------------------------------------------------------------
+{
+  if( _fmt == PLY )
+  {
+    for( size_t i = 0 ; i < n ; ++i )
+    {
+      char *dst = reserve( PLY_FACE, fp ) ;
+      dst[0] = 3 ;
+      put32( dst + 1, &t[i].v1, _swap ) ;
+      put32( dst + 5, &t[i].v2, _swap ) ;
+      put32( dst + 9, &t[i].v3, _swap ) ;
+    }
+    return ;
+  }
+
+  const size_t nv = _pos.size() / 3 ;
+  for( size_t i = 0 ; i < n ; ++i )
+  {
+    const int id[3] = { t[i].v1, t[i].v2, t[i].v3 } ;
+    float f[12] = { 0 } ;
+    for( int c = 0 ; c < 3 ; ++c )
+    {
+      if( id[c] < 0 || (size_t)id[c] >= nv ) { _error = true ; continue ; }
+      memcpy( f + 3 + 3*c, &_pos[3*id[c]], 3 * sizeof(float) ) ;
+    }
+
+    // facet normal
+    const float ux = f[6] - f[3], uy = f[7] - f[4], uz = f[ 8] - f[5] ;
+    const float vx = f[9] - f[3], vy = f[10]- f[4], vz = f[11] - f[5] ;
+    f[0] = uy*vz - uz*vy ;  f[1] = uz*vx - ux*vz ;  f[2] = ux*vy - uy*vx ;
+    float nrm = f[0]*f[0] + f[1]*f[1] + f[2]*f[2] ;
+    if( nrm > 0 )
+    {
+      nrm = 1.0f / sqrtf( nrm ) ;
+      f[0] *= nrm ;  f[1] *= nrm ;  f[2] *= nrm ;
+    }
+
+    char *dst = reserve( STL_FACET, fp ) ;
+    for( int c = 0 ; c < 12 ; ++c ) put32( dst + 4*c, f + c, _swap ) ;
+    dst[48] = dst[49] = 0 ;
+  }
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// reserves n bytes in the buffer of fp
+char *MeshWriter::reserve( size_t n, FILE *fp )
+//-----------------------------------------------------------------------------
+{
+  if( fp != _buf_fp || _len + n > _buf.size() )
+  {
+    flush() ;
+    _buf_fp = fp ;
+  }
+  char *p = _buf.data() + _len ;
+  _len += n ;
+  return p ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// writes the buffer to its file
+void MeshWriter::flush()
+//-----------------------------------------------------------------------------
+{
+  MC_TRACE_SPAN( "MeshWriter::flush" ) ;
+  if( _len > 0 && fwrite( _buf.data(), 1, _len, _buf_fp ) != _len ) _error = true ;
+  _len = 0 ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// flushes the remaining elements, completes the header and closes the file
+bool MeshWriter::close()
+//-----------------------------------------------------------------------------
+{
+  if( !_fp ) return true ;
+  MC_TRACE_SPAN( "MeshWriter::close" ) ;
+  flush() ;
+
+  if( _spill )
+  {
+    // appends the faces after the vertices
+    fflush( _spill ) ;
+    rewind( _spill ) ;
+    size_t n ;
+    while( ( n = fread( _buf.data(), 1, _buf.size(), _spill ) ) > 0 )
+      if( fwrite( _buf.data(), 1, n, _fp ) != n ) { _error = true ; break ; }
+    if( ferror( _spill ) ) _error = true ;
+    fclose( _spill ) ;
+    _spill = NULL ;
+  }
+
+  // element counts
+  if( fseek( _fp, 0, SEEK_SET ) != 0 ) _error = true ;
+  else write_header( _nv, _nt ) ;
+
+  if( fclose( _fp ) != 0 ) _error = true ;
+  _fp = _buf_fp = NULL ;
+  _buf.clear() ;
+  _buf.shrink_to_fit() ;
+  _pos.clear() ;
+  _pos.shrink_to_fit() ;
+
+  if( _error ) printf( "MeshWriter::close error : the file is incomplete\n" ) ;
+  return !_error ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// writes a whole mesh at once
+bool MeshWriter::write( const char *fn, Format fmt, const Vertex *v, size_t nv, const Triangle *t, size_t nt )
+//-----------------------------------------------------------------------------
+{
+  MeshWriter w ;
+  if( !w.open( fn, fmt ) ) return false ;
+
+  // all the vertices are known: the faces go straight to the file
+  w.add_vertices( v, nv ) ;
+  w.put_triangles( t, nt, w._fp ) ;
+  w._nt += nt ;
+  return w.close() ;
+}
+//_____________________________________________________________________________
+
+
+
+
+//_____________________________________________________________________________
+// reads a PLY mesh
+bool MeshReader::read( const char *fn, MCBuffer<Vertex> &verts, MCBuffer<Triangle> &trigs )
+//-----------------------------------------------------------------------------
+{
+  MC_TRACE_SPAN( "MeshReader::read" ) ;
+  verts.clear() ;
+  trigs.clear() ;
+  if( read_mapped( fn, verts, trigs ) ) return true ;
+
+  verts.clear() ;
+  trigs.clear() ;
+  return read_generic( fn, verts, trigs ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// size in bytes of a PLY scalar type, 0 if unknown
+static int ply_type_size( const std::string &type )
+//-----------------------------------------------------------------------------
+{
+  if( type == "char"  || type == "uchar"  || type == "int8"  || type == "uint8"  ) return 1 ;
+  if( type == "short" || type == "ushort" || type == "int16" || type == "uint16" ) return 2 ;
+  if( type == "int"   || type == "uint"   || type == "int32" || type == "uint32" ) return 4 ;
+  if( type == "float" || type == "float32" ) return 4 ;
+  if( type == "double"|| type == "float64" ) return 8 ;
+  return 0 ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// mapped reading of the common layouts
+bool MeshReader::read_mapped( const char *fn, MCBuffer<Vertex> &verts, MCBuffer<Triangle> &trigs )
+//-----------------------------------------------------------------------------
+{
+#ifdef WIN32
+  return false ;
+#else  // WIN32
+  const int one = 1 ;
+  if( *(const char*)&one == 0 ) return false ;  // big endian host
+
+  const int fd = ::open( fn, O_RDONLY ) ;
+  if( fd < 0 ) return false ;
+  struct stat st ;
+  if( fstat( fd, &st ) != 0 || st.st_size <= 0 ) { ::close( fd ) ; return false ; }
+  const size_t size = (size_t)st.st_size ;
+  void *map = mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 ) ;
+  ::close( fd ) ;
+  if( map == MAP_FAILED ) return false ;
+  const char *data = (const char*)map ;
+
+  // header
+  const char   *end_tag = "end_header" ;
+  const size_t  max_hdr = size < 65536 ? size : 65536 ;
+  const char   *hdr_end = NULL ;
+  for( size_t p = 0 ; p + 10 <= max_hdr && !hdr_end ; ++p )
+    if( ( p == 0 || data[p-1] == '\n' ) && !memcmp( data + p, end_tag, 10 ) ) hdr_end = data + p ;
+
+  bool ok = hdr_end && size >= 4 && !memcmp( data, "ply", 3 ) ;
+  size_t body = 0 ;
+  if( ok )
+  {
+    const char *nl = (const char*)memchr( hdr_end, '\n', data + size - hdr_end ) ;
+    ok = nl != NULL ;
+    if( ok ) body = nl + 1 - data ;
+  }
+
+  long nv = -1, nf = -1 ;
+  int  elem = 0, stride = 0, off[6] = { -1, -1, -1, -1, -1, -1 }, face_props = 0 ;
+  bool binary_le = false ;
+  static const char *names[6] = { "x", "y", "z", "nx", "ny", "nz" } ;
+
+  std::istringstream hdr( ok ? std::string( data, hdr_end ) : std::string() ) ;
+  std::string line ;
+  while( ok && std::getline( hdr, line ) )
+  {
+    std::istringstream words( line ) ;
+    std::string key ;
+    words >> key ;
+
+    if( key == "format" )
+    {
+      std::string fmt ;
+      words >> fmt ;
+      binary_le = fmt == "binary_little_endian" ;
+    }
+    else if( key == "element" )
+    {
+      // a vertex element followed by a face element only
+      std::string name ;
+      long n = -1 ;
+      words >> name >> n ;
+      ++elem ;
+      if     ( elem == 1 && name == "vertex" ) nv = n ;
+      else if( elem == 2 && name == "face"   ) nf = n ;
+      else ok = false ;
+    }
+    else if( key == "property" )
+    {
+      std::string type, name ;
+      words >> type ;
+      if( elem == 1 )
+      {
+        // scalar vertex properties, skipped by the stride when unused
+        words >> name ;
+        const int s = ply_type_size( type ) ;
+        ok = s > 0 ;
+        for( int c = 0 ; c < 6 ; ++c )
+          if( name == names[c] ) off[c] = ( s == 4 && type[0] == 'f' ) ? stride : -2 ;
+        stride += s ;
+      }
+      else if( elem == 2 )
+      {
+        // list of 32 bits indices with a 8 bits count
+        std::string count, index ;
+        words >> count >> index >> name ;
+        ok = type == "list" && ply_type_size( count ) == 1 && ply_type_size( index ) == 4 && index[0] != 'f' &&
+             ( name == "vertex_indices" || name == "vertex_index" ) && ++face_props == 1 ;
+      }
+      else
+        ok = false ;
+    }
+  }
+
+  // float coordinates, all the normals in float or none
+  const bool normals = off[3] >= 0 && off[4] >= 0 && off[5] >= 0 ;
+  ok = ok && ( normals || ( off[3] == -1 && off[4] == -1 && off[5] == -1 ) ) ;
+  ok = ok && binary_le && elem == 2 && face_props == 1 && nv >= 0 && nf >= 0 && off[0] >= 0 && off[1] >= 0 && off[2] >= 0 ;
+  ok = ok && body + (size_t)nv * stride + (size_t)nf * ( 1 + 3*sizeof(int) ) <= size ;
+
+  if( ok )
+  {
+    verts.resize( nv ) ;
+    const char *src = data + body ;
+    if( normals && stride == sizeof(Vertex) && sizeof(Vertex) == 6*sizeof(float) &&
+        off[0] == 0 && off[1] == 4 && off[2] == 8 && off[3] == 12 && off[4] == 16 && off[5] == 20 )
+      memcpy( verts.data(), src, nv * sizeof(Vertex) ) ;
+    else
+    {
+      for( long i = 0 ; i < nv ; ++i, src += stride )
+      {
+        Vertex &v = verts[i] ;
+        memcpy( &v.x, src + off[0], 4 ) ;
+        memcpy( &v.y, src + off[1], 4 ) ;
+        memcpy( &v.z, src + off[2], 4 ) ;
+        if( normals )
+        {
+          memcpy( &v.nx, src + off[3], 4 ) ;
+          memcpy( &v.ny, src + off[4], 4 ) ;
+          memcpy( &v.nz, src + off[5], 4 ) ;
+        }
+        else
+          v.nx = v.ny = v.nz = 0 ;
+      }
+    }
+    src = data + body + (size_t)nv * stride ;
+
+    // triangles only, the polygons are left to the generic reader
+    trigs.resize( nf ) ;
+    for( long i = 0 ; i < nf && ok ; ++i, src += 1 + 3*sizeof(int) )
+    {
+      Triangle &t = trigs[i] ;
+      memcpy( &t.v1, src + 1, 4 ) ;
+      memcpy( &t.v2, src + 5, 4 ) ;
+      memcpy( &t.v3, src + 9, 4 ) ;
+      ok = src[0] == 3 && (unsigned)t.v1 < (unsigned long)nv && (unsigned)t.v2 < (unsigned long)nv && (unsigned)t.v3 < (unsigned long)nv ;
+    }
+  }
+
+  munmap( map, size ) ;
+  return ok ;
+#endif // WIN32
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// generic reading through ply.c
+bool MeshReader::read_generic( const char *fn, MCBuffer<Vertex> &verts, MCBuffer<Triangle> &trigs )
+//-----------------------------------------------------------------------------
+{
+  FILE *fp = fopen( fn, "rb" ) ;
+  if( !fp )
+  {
+    printf( "MeshReader::read error : cannot open %s\n", fn ) ;
+    return false ;
+  }
+  PlyFile *ply = read_ply( fp ) ;
+  if( !ply )
+  {
+    printf( "MeshReader::read error : %s is not a PLY file\n", fn ) ;
+    fclose( fp ) ;
+    return false ;
+  }
+
+  typedef struct { unsigned char nverts ; int *verts ; } Face ;
+  PlyProperty vert_props[6] =
+  {
+    { (char*)"x" , Float32, Float32, offsetof(Vertex,x ), 0, 0, 0, 0 },
+    { (char*)"y" , Float32, Float32, offsetof(Vertex,y ), 0, 0, 0, 0 },
+    { (char*)"z" , Float32, Float32, offsetof(Vertex,z ), 0, 0, 0, 0 },
+    { (char*)"nx", Float32, Float32, offsetof(Vertex,nx), 0, 0, 0, 0 },
+    { (char*)"ny", Float32, Float32, offsetof(Vertex,ny), 0, 0, 0, 0 },
+    { (char*)"nz", Float32, Float32, offsetof(Vertex,nz), 0, 0, 0, 0 },
+  } ;
+  PlyProperty face_prop =
+    { (char*)"vertex_indices", Int32, Int32, offsetof(Face,verts), PLY_LIST, Uint8, Uint8, offsetof(Face,nverts) } ;
+
+  int nelems ;
+  char **elist = get_element_list_ply( ply, &nelems ) ;
+  bool ok = true ;
+  for( int e = 0 ; e < nelems ; ++e )
+  {
+    int num ;
+    char *name = setup_element_read_ply( ply, e, &num ) ;
+    PlyElement *elem = ply->which_elem ;
+
+    // properties of the file, to avoid the warnings of the missing ones
+    bool has[6] = { false, false, false, false, false, false }, has_face = false ;
+    for( int p = 0 ; p < elem->nprops ; ++p )
+    {
+      for( int c = 0 ; c < 6 ; ++c ) has[c] = has[c] || !strcmp( elem->props[p]->name, vert_props[c].name ) ;
+      has_face = has_face || !strcmp( elem->props[p]->name, "vertex_indices" ) ;
+    }
+
+    if( !strcmp( name, "vertex" ) )
+    {
+      for( int c = 0 ; c < 6 ; ++c ) if( has[c] ) setup_property_ply( ply, vert_props + c ) ;
+      const size_t v0 = verts.size() ;
+      verts.resize( v0 + num ) ;
+      for( int i = 0 ; i < num ; ++i )
+      {
+        Vertex &v = verts[v0 + i] ;
+        v.x = v.y = v.z = v.nx = v.ny = v.nz = 0 ;
+        get_element_ply( ply, &v ) ;
+      }
+    }
+    else if( !strcmp( name, "face" ) && has_face )
+    {
+      setup_property_ply( ply, &face_prop ) ;
+      for( int i = 0 ; i < num ; ++i )
+      {
+        Face f = { 0, NULL } ;
+        get_element_ply( ply, &f ) ;
+        for( int c = 2 ; c < f.nverts ; ++c )
+        {
+          Triangle t = { f.verts[0], f.verts[c-1], f.verts[c] } ;
+          trigs.push_back( t ) ;
+        }
+        free( f.verts ) ;
+      }
+    }
+    else
+    {
+      // skipped
+      char dummy[64] ;
+      for( int i = 0 ; i < num ; ++i ) get_element_ply( ply, dummy ) ;
+    }
+    free( elist[e] ) ;
+  }
+  free( elist ) ;
+
+  close_ply( ply ) ;
+  free_ply ( ply ) ;
+
+  for( size_t i = 0 ; i < trigs.size() && ok ; ++i )
+    ok = (size_t)trigs[i].v1 < verts.size() && (size_t)trigs[i].v2 < verts.size() && (size_t)trigs[i].v3 < verts.size() ;
+  if( !ok ) printf( "MeshReader::read error : invalid vertex index in %s\n", fn ) ;
+  return ok ;
+}
+//_____________________________________________________________________________
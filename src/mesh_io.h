@@ -0,0 +1,136 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// Mesh input / output
+// Binary PLY and STL files written by large blocks
+//
+//________________________________________________
+
+
+#ifndef _MESH_IO_H_
+#define _MESH_IO_H_
+
+#include <stdio.h>
+#include <vector>
+#include "MarchingCubes.h"
+
+//_____________________________________________________________________________
+// Streaming binary mesh writer
+/** \class MeshWriter
+  * \brief Writes a mesh received by pieces to a binary little endian PLY or a binary STL file.
+  * The vertices and triangles are packed in a large buffer and written by blocks, with no per element descriptor.
+  * The triangles index the vertices in their order of arrival, and the element counts are completed by close.
+  * The PLY faces must follow all the vertices : add_triangles spills all of them to a temporary file, which close
+  * copies after the vertices, so that the streamed PLY faces are written twice. The STL facets and the faces of write
+  * are written once.
+  */
+class MeshWriter
+//-----------------------------------------------------------------------------
+{
+//-----------------------------------------------------------------------------
+// Constructors
+public :
+  /** output file formats */
+  enum Format { PLY, STL } ;
+  /** size of the write buffer, in bytes */
+  enum { BUFFER = 1 << 22 } ;
+
+  MeshWriter() : _fp(NULL), _spill(NULL), _buf_fp(NULL), _fmt(PLY), _nv(0), _nt(0), _swap(false), _error(false), _len(0) {}
+  ~MeshWriter() { close() ; }
+
+//-----------------------------------------------------------------------------
+// Operations
+public :
+  /**
+   * creates the file and writes its header
+   * \param fn  name of the file to create
+   * \param fmt format of the file
+   * \return false if the file could not be created
+   */
+  bool open( const char *fn, Format fmt = PLY ) ;
+
+  /** appends vertices to the mesh */
+  void add_vertices ( const Vertex   *v, size_t n ) ;
+  /** appends triangles to the mesh, indexing all the vertices appended so far, through the temporary file in PLY */
+  void add_triangles( const Triangle *t, size_t n ) ;
+
+  /**
+   * flushes the remaining elements, completes the header and closes the file
+   * \return false if a write failed
+   */
+  bool close() ;
+
+  /** true between open and close */
+  inline bool is_open() const { return _fp != NULL ; }
+
+  /**
+   * writes a whole mesh at once, without the temporary file of the streaming PLY output
+   * \param fn  name of the file to create
+   * \param fmt format of the file
+   * \return false if the file could not be written
+   */
+  static bool write( const char *fn, Format fmt, const Vertex *v, size_t nv, const Triangle *t, size_t nt ) ;
+
+private :
+  /** writes the header with the given element counts */
+  void write_header( size_t nv, size_t nt ) ;
+  /** packs the vertices in the buffer */
+  void put_vertices ( const Vertex   *v, size_t n ) ;
+  /** packs the triangles in the buffer of fp */
+  void put_triangles( const Triangle *t, size_t n, FILE *fp ) ;
+  /** reserves n bytes in the buffer of fp, flushing it if needed */
+  char *reserve( size_t n, FILE *fp ) ;
+  /** writes the buffer to its file */
+  void flush() ;
+
+//-----------------------------------------------------------------------------
+// Elements
+private :
+  FILE    *_fp     ;  /**< output file */
+  FILE    *_spill  ;  /**< temporary file of the PLY faces, copied after the vertices by close */
+  FILE    *_buf_fp ;  /**< file of the buffered data */
+  Format   _fmt    ;  /**< format of the output file */
+  size_t   _nv     ;  /**< number of vertices written */
+  size_t   _nt     ;  /**< number of triangles written */
+  bool     _swap   ;  /**< big endian host */
+  bool     _error  ;  /**< a write failed */
+  std::vector<char>  _buf ;  /**< write buffer */
+  size_t             _len ;  /**< bytes used in the buffer */
+  std::vector<float> _pos ;  /**< vertex positions, for the STL facets */
+};
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// Bulk PLY reader
+/** \class MeshReader
+  * \brief Reads a PLY mesh. Binary little endian files with float x,y,z[,nx,ny,nz] vertices and triangle faces
+  * are mapped in memory and copied in bulk, the other files go through the generic reader of ply.c.
+  */
+class MeshReader
+//-----------------------------------------------------------------------------
+{
+//-----------------------------------------------------------------------------
+// Operations
+public :
+  /**
+   * reads a PLY mesh
+   * \param fn    name of the PLY file
+   * \param verts vertices of the mesh, with null normals if the file has none
+   * \param trigs triangles of the mesh, the polygons are split in fans
+   * \return false if the file could not be read
+   */
+  static bool read( const char *fn, MCBuffer<Vertex> &verts, MCBuffer<Triangle> &trigs ) ;
+
+private :
+  /** mapped reading of the common layouts, false to fall back to the generic reader */
+  static bool read_mapped ( const char *fn, MCBuffer<Vertex> &verts, MCBuffer<Triangle> &trigs ) ;
+  /** generic reading through ply.c */
+  static bool read_generic( const char *fn, MCBuffer<Vertex> &verts, MCBuffer<Triangle> &trigs ) ;
+};
+//_____________________________________________________________________________
+
+
+#endif // _MESH_IO_H_
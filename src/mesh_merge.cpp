@@ -0,0 +1,72 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// Mesh merging
+// Welding of meshes extracted separately, by grid edge
+//
+//________________________________________________
+
+
+#include "mesh_merge.h"
+
+
+//_____________________________________________________________________________
+// reserves the buffers
+void MeshMerger::reserve( size_t nv, size_t nt )
+//-----------------------------------------------------------------------------
+{
+  _verts.reserve( nv ) ;
+  _keys .reserve( nv ) ;
+  _trigs.reserve( nt ) ;
+  _index.reserve( nv ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// appends a mesh
+size_t MeshMerger::add( const Vertex *v, const int64_t *keys, size_t nv, const Triangle *t, size_t nt )
+//-----------------------------------------------------------------------------
+{
+  size_t welded = 0 ;
+  _remap.resize( nv ) ;
+  for( size_t i = 0 ; i < nv ; ++i )
+  {
+    const int id = (int)_verts.size() ;
+    if( keys && keys[i] >= 0 )
+    {
+      std::pair<std::unordered_map<int64_t,int>::iterator,bool> it = _index.insert( std::make_pair( keys[i], id ) ) ;
+      _remap[i] = it.first->second ;
+      if( !it.second ) { ++welded ;  continue ; }
+    }
+    else
+      _remap[i] = id ;
+    _verts.push_back( v[i] ) ;
+    _keys .push_back( keys ? keys[i] : -1 ) ;
+  }
+
+  for( size_t i = 0 ; i < nt ; ++i )
+  {
+    Triangle u = t[i] ;
+    u.v1 = _remap[u.v1] ;  u.v2 = _remap[u.v2] ;  u.v3 = _remap[u.v3] ;
+    _trigs.push_back( u ) ;
+  }
+  return welded ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// removes all the merged meshes
+void MeshMerger::clear()
+//-----------------------------------------------------------------------------
+{
+  _verts.clear() ;
+  _trigs.clear() ;
+  _keys .clear() ;
+  _index.clear() ;
+}
+//_____________________________________________________________________________
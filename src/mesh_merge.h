@@ -0,0 +1,79 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// Mesh merging
+// Welding of meshes extracted separately, by grid edge
+//
+//________________________________________________
+
+
+#ifndef _MESH_MERGE_H_
+#define _MESH_MERGE_H_
+
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+#include "MarchingCubes.h"
+
+//_____________________________________________________________________________
+// Keyed mesh merger
+/** \class MeshMerger
+  * \brief Concatenates meshes whose vertices are keyed by their grid edge (MarchingCubes::set_edge_keys), keeping one
+  * vertex per key : the parts of a grid extracted separately are welded into one watertight mesh, in a time linear in
+  * the number of vertices. The vertices without key are never welded.
+  */
+class MeshMerger
+//-----------------------------------------------------------------------------
+{
+//-----------------------------------------------------------------------------
+// Constructors
+public :
+  /**
+   * constructor
+   * \param resource memory of the merged mesh, the heap if null
+   */
+  MeshMerger( MemoryResource *resource = NULL ) : _verts( resource ), _trigs( resource ), _keys( resource ) {}
+
+//-----------------------------------------------------------------------------
+// Operations
+public :
+  /** reserves the buffers for nv vertices and nt triangles */
+  void reserve( size_t nv, size_t nt ) ;
+
+  /**
+   * appends a mesh, welding its keyed vertices on the vertices of the same key already merged
+   * \param v    vertices of the mesh
+   * \param keys grid edge of each vertex, -1 for no key
+   * \param nv   number of vertices
+   * \param t    triangles indexing v
+   * \param nt   number of triangles
+   * \return number of vertices welded
+   */
+  size_t add( const Vertex *v, const int64_t *keys, size_t nv, const Triangle *t, size_t nt ) ;
+  /** appends the mesh of a keyed MarchingCubes */
+  inline size_t add( MarchingCubes &mc ) { return add( mc.vertices(), mc.keys(), mc.nverts(), mc.triangles(), mc.ntrigs() ) ; }
+
+  /** removes all the merged meshes */
+  void clear() ;
+
+  /** merged vertices */
+  inline MCBuffer<Vertex>   &vertices () { return _verts ; }
+  /** merged triangles */
+  inline MCBuffer<Triangle> &triangles() { return _trigs ; }
+  /** key of each merged vertex */
+  inline MCBuffer<int64_t>  &keys     () { return _keys  ; }
+
+//-----------------------------------------------------------------------------
+// Elements
+private :
+  MCBuffer<Vertex>      _verts ;  /**< merged vertices */
+  MCBuffer<Triangle>    _trigs ;  /**< merged triangles */
+  MCBuffer<int64_t>     _keys  ;  /**< key of each merged vertex */
+  std::unordered_map<int64_t,int> _index ;  /**< merged vertex of each key */
+  std::vector<int>      _remap ;  /**< merged vertex of each vertex of the mesh being added */
+};
+//_____________________________________________________________________________
+
+
+#endif // _MESH_MERGE_H_
@@ -0,0 +1,141 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// Pipeline
+// Concurrent sampling, tesselation and writing by slabs
+//
+//________________________________________________
+
+
+#include <math.h>
+#include "pipeline.h"
+#include "trace.h"
+
+
+//_____________________________________________________________________________
+// runs the pipeline
+bool MeshPipeline::run( const glm::ivec3 &size, const SampleFunction &f, MeshWriter &out, real iso,
+                        const glm::vec3 &origin, const glm::vec3 &step, bool originalMC )
+//-----------------------------------------------------------------------------
+{
+  _nverts = _ntrigs = 0 ;
+  if( size.x < 2 || size.y < 2 || size.z < 2 ) return false ;
+
+  // buffers cycling between the stages
+  std::vector<Slab>  slabs ( _depth ) ;
+  std::vector<Piece> pieces( _depth ) ;
+  SpscQueue<Slab*>  full_slabs ( _depth + 1 ), free_slabs ( _depth ) ;
+  SpscQueue<Piece*> full_pieces( _depth + 1 ), free_pieces( _depth ) ;
+  for( int b = 0 ; b < _depth ; ++b ) { free_slabs.push( &slabs[b] ) ;  free_pieces.push( &pieces[b] ) ; }
+
+  // sampling, with one ghost layer below and above the slab inside the grid for the central differences of the normals
+  std::thread sampler( [&]()
+  {
+    for( int k0 = 0 ; k0 < size.z - 1 ; k0 += _slab )
+    {
+      Slab *s = free_slabs.pop() ;
+      MC_TRACE_SPAN( "sample slab" ) ;
+      s->k0 = k0 ;
+      s->k1 = std::min( k0 + _slab, size.z - 1 ) ;
+      s->g0 = std::max( k0 - 1, 0 ) ;
+      s->nz = std::min( s->k1 + 1, size.z - 1 ) - s->g0 + 1 ;
+      s->data.resize( (size_t)size.x * size.y * s->nz ) ;
+      f( glm::ivec3( 0, 0, s->g0 ), glm::ivec3( 1 ), glm::ivec3( size.x, size.y, s->nz ), s->data.data() ) ;
+      full_slabs.push( s ) ;
+    }
+    full_slabs.push( NULL ) ;
+  } ) ;
+
+  // tesselation
+  std::thread extractor( [&]() { extract( size, iso, origin, step, originalMC, full_slabs, free_slabs, full_pieces, free_pieces ) ; } ) ;
+
+  // writing, the vertices being already in world coordinates with unit normals
+  for( Piece *p ; ( p = full_pieces.pop() ) != NULL ; free_pieces.push( p ) )
+  {
+    MC_TRACE_SPAN( "write slab" ) ;
+    out.add_vertices ( p->verts.data(), p->verts.size() ) ;
+    out.add_triangles( p->trigs.data(), p->trigs.size() ) ;
+    _nverts += p->verts.size() ;
+    _ntrigs += p->trigs.size() ;
+  }
+
+  sampler  .join() ;
+  extractor.join() ;
+  return true ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// tesselates the slabs
+void MeshPipeline::extract( const glm::ivec3 &size, real iso, const glm::vec3 &origin, const glm::vec3 &step, bool originalMC,
+                            SpscQueue<Slab*> &full, SpscQueue<Slab*> &free_slabs, SpscQueue<Piece*> &pieces, SpscQueue<Piece*> &free_pieces )
+//-----------------------------------------------------------------------------
+{
+  MarchingCubes mc ;
+  mc.set_method( originalMC ) ;
+  mc.set_transform( origin, step ) ;
+
+  // indices in the whole mesh of the vertices on the x and y edges of the top layer of the previous slab
+  const size_t layer = (size_t)size.x * size.y ;
+  std::vector<int> top_x( layer, -1 ), top_y( layer, -1 ), remap ;
+  int nverts = 0 ;
+
+  for( Slab *s ; ( s = full.pop() ) != NULL ; free_slabs.push( s ) )
+  {
+    MC_TRACE_SPAN( "extract slab" ) ;
+    // layers of the slab in its samples, the ghost layers being sampled only
+    const int bottom = s->k0 - s->g0, top = s->k1 - s->g0 ;
+    mc.set_resolution( size.x, size.y, s->nz ) ;
+    mc.set_region( glm::ivec3( 0, 0, bottom ), glm::ivec3( size.x-1, size.y-1, top ), glm::ivec3( 0, 0, s->g0 ) ) ;
+    mc.init_all() ;
+    for( int k = 0 ; k < s->nz ; ++k )
+    for( int j = 0 ; j < size.y ; ++j )
+    for( int i = 0 ; i < size.x ; ++i )
+      mc.set_data( s->data[ i + size.x * ( j + (size_t)size.y * k ) ], i,j,k ) ;
+    mc.run( iso ) ;
+
+    // the bottom layer was the top layer of the previous slab
+    remap.assign( mc.nverts(), -1 ) ;
+    if( s->k0 > 0 )
+    {
+      for( int j = 0 ; j < size.y ; ++j )
+      for( int i = 0 ; i < size.x ; ++i )
+      {
+        const int vx = mc.get_x_vert( i,j,bottom ), vy = mc.get_y_vert( i,j,bottom ) ;
+        if( vx >= 0 ) remap[vx] = top_x[ i + size.x * j ] ;
+        if( vy >= 0 ) remap[vy] = top_y[ i + size.x * j ] ;
+      }
+    }
+
+    Piece *p = free_pieces.pop() ;
+    p->verts.clear() ;
+    p->trigs.clear() ;
+    for( int v = 0 ; v < mc.nverts() ; ++v )
+    {
+      if( remap[v] >= 0 ) continue ;
+      remap[v] = nverts++ ;
+      p->verts.push_back( *mc.vert( v ) ) ;
+    }
+    for( int t = 0 ; t < mc.ntrigs() ; ++t )
+    {
+      Triangle tr = *mc.trig( t ) ;
+      tr.v1 = remap[tr.v1] ;  tr.v2 = remap[tr.v2] ;  tr.v3 = remap[tr.v3] ;
+      p->trigs.push_back( tr ) ;
+    }
+
+    for( int j = 0 ; j < size.y ; ++j )
+    for( int i = 0 ; i < size.x ; ++i )
+    {
+      const int vx = mc.get_x_vert( i,j,top ), vy = mc.get_y_vert( i,j,top ) ;
+      top_x[ i + size.x * j ] = vx >= 0 ? remap[vx] : -1 ;
+      top_y[ i + size.x * j ] = vy >= 0 ? remap[vy] : -1 ;
+    }
+
+    pieces.push( p ) ;
+  }
+  pieces.push( NULL ) ;
+}
+//_____________________________________________________________________________
@@ -0,0 +1,139 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// Pipeline
+// Concurrent sampling, tesselation and writing by slabs
+//
+//________________________________________________
+
+
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "MarchingCubes.h"
+#include "mesh_io.h"
+
+//_____________________________________________________________________________
+// Bounded lock-free queue
+/** \class SpscQueue
+  * \brief Ring buffer between exactly one producer thread and one consumer thread.
+  * The blocking operations yield while the queue is full or empty.
+  */
+template <class T> class SpscQueue
+//-----------------------------------------------------------------------------
+{
+//-----------------------------------------------------------------------------
+// Constructors
+public :
+  /** queue holding at most capacity elements */
+  SpscQueue( size_t capacity ) : _buf( capacity + 1 ), _head(0), _tail(0) {}
+
+//-----------------------------------------------------------------------------
+// Operations
+public :
+  /** appends v, false if the queue is full */
+  inline bool try_push( const T &v )
+  {
+    const size_t t = _tail.load( std::memory_order_relaxed ), n = next( t ) ;
+    if( n == _head.load( std::memory_order_acquire ) ) return false ;
+    _buf[t] = v ;
+    _tail.store( n, std::memory_order_release ) ;
+    return true ;
+  }
+  /** removes the first element into v, false if the queue is empty */
+  inline bool try_pop( T &v )
+  {
+    const size_t h = _head.load( std::memory_order_relaxed ) ;
+    if( h == _tail.load( std::memory_order_acquire ) ) return false ;
+    v = _buf[h] ;
+    _head.store( next( h ), std::memory_order_release ) ;
+    return true ;
+  }
+
+  /** appends v, waiting for a free place */
+  inline void push( const T &v ) { while( !try_push( v ) ) std::this_thread::yield() ; }
+  /** removes the first element, waiting for one */
+  inline T    pop () { T v ;  while( !try_pop( v ) ) std::this_thread::yield() ;  return v ; }
+
+private :
+  inline size_t next( size_t i ) const { return ( i + 1 == _buf.size() ) ? 0 : i + 1 ; }
+
+//-----------------------------------------------------------------------------
+// Elements
+private :
+  std::vector<T>      _buf  ;  /**< ring of capacity + 1 places */
+  std::atomic<size_t> _head ;  /**< next place to read, owned by the consumer */
+  std::atomic<size_t> _tail ;  /**< next place to write, owned by the producer */
+};
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// Slab pipeline
+/** \class MeshPipeline
+  * \brief Extracts an isosurface by slabs of z layers, with the sampling of a slab, the tesselation of the previous one
+  * and the writing of the mesh pieces running concurrently. The stages exchange their buffers through bounded queues,
+  * so that the memory stays proportional to the slab size and the queue depth.
+  */
+class MeshPipeline
+//-----------------------------------------------------------------------------
+{
+//-----------------------------------------------------------------------------
+// Constructors
+public :
+  /**
+   * \param slab  number of cube layers per slab
+   * \param depth number of buffers in flight between two stages
+   */
+  MeshPipeline( int slab = 32, int depth = 4 ) : _slab( std::max( slab, 1 ) ), _depth( std::max( depth, 1 ) ), _nverts(0), _ntrigs(0) {}
+
+//-----------------------------------------------------------------------------
+// Operations
+public :
+  /**
+   * runs the pipeline : f is called from a sampling thread, the slabs are tesselated on a second thread and the mesh
+   * is written from the calling thread. The vertices shared by two slabs are written once.
+   * \param size       number of samples along each axis
+   * \param f          sampling callback
+   * \param out        open writer receiving the mesh
+   * \param iso        isovalue
+   * \param origin     position of the first sample
+   * \param step       spacing of the samples along each axis
+   * \param originalMC true for the original Marching Cubes
+   * \return false if the grid is too small
+   */
+  bool run( const glm::ivec3 &size, const SampleFunction &f, MeshWriter &out, real iso = (real)0.0,
+            const glm::vec3 &origin = glm::vec3(0.0f), const glm::vec3 &step = glm::vec3(1.0f), bool originalMC = false ) ;
+
+  /** number of vertices written by the last run */
+  inline size_t nverts() const { return _nverts ; }
+  /** number of triangles written by the last run */
+  inline size_t ntrigs() const { return _ntrigs ; }
+
+private :
+  /** samples of the cube layers k0 to k1 of a slab, with a ghost layer on each side inside the grid, from the layer g0 */
+  struct Slab  { int k0, k1, g0, nz ; std::vector<float> data ; } ;
+  /** mesh of a slab, in world coordinates, with the triangles indexing the vertices of the whole mesh */
+  struct Piece { std::vector<Vertex> verts ; std::vector<Triangle> trigs ; } ;
+
+  /** tesselates the slabs of full until the end mark, and sends their meshes to pieces */
+  void extract( const glm::ivec3 &size, real iso, const glm::vec3 &origin, const glm::vec3 &step, bool originalMC,
+                SpscQueue<Slab*> &full, SpscQueue<Slab*> &free_slabs, SpscQueue<Piece*> &pieces, SpscQueue<Piece*> &free_pieces ) ;
+
+//-----------------------------------------------------------------------------
+// Elements
+private :
+  int    _slab   ;  /**< cube layers per slab */
+  int    _depth  ;  /**< buffers in flight between two stages */
+  size_t _nverts ;  /**< vertices written */
+  size_t _ntrigs ;  /**< triangles written */
+};
+//_____________________________________________________________________________
+
+
+#endif // _PIPELINE_H_
@@ -0,0 +1,175 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// Trace
+// Timed spans exported as Chrome trace events
+//
+//________________________________________________
+
+
+#include <stdio.h>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#ifndef WIN32
+#include <unistd.h>
+#endif // WIN32
+#include "trace.h"
+
+
+std::atomic<bool> Trace::_enabled( false ) ;
+
+//_____________________________________________________________________________
+// ring of the spans of a thread
+namespace
+{
+  struct Span { const char *name ; uint64_t begin, end ; } ;
+
+  struct Ring
+  {
+    Ring( int s ) : slot( s ), count( 0 ), spans( Trace::CAPACITY ) {}
+    int                   slot  ;  // slot number, shared by the successive threads of the ring
+    std::atomic<uint64_t> count ;  // spans written since the last clear
+    std::vector<Span>     spans ;
+  } ;
+
+  // rings by slot, as many as the threads recording at once : the ring of an ended thread is taken over by the next
+  // one, its spans staying until they are overwritten
+  std::mutex                           rings_mutex ;
+  std::vector< std::unique_ptr<Ring> > rings      ;
+  std::vector<Ring*>                   free_rings ;
+
+  // ring of the calling thread, given back to the free rings when the thread ends
+  struct RingHolder
+  {
+    RingHolder() : ring( NULL ) {}
+    ~RingHolder()
+    {
+      if( !ring ) return ;
+      std::lock_guard<std::mutex> lock( rings_mutex ) ;
+      free_rings.push_back( ring ) ;
+    }
+    Ring *ring ;
+  } ;
+  thread_local RingHolder holder ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// recording switch
+void Trace::enable( bool on )
+//-----------------------------------------------------------------------------
+{
+  now() ;
+  _enabled.store( on, std::memory_order_relaxed ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// clock
+uint64_t Trace::now()
+//-----------------------------------------------------------------------------
+{
+  static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now() ;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count() ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// records a span
+void Trace::record( const char *name, uint64_t begin, uint64_t end )
+//-----------------------------------------------------------------------------
+{
+  // the ring of the thread is taken on its first span only, a free one if any
+  Ring *ring = holder.ring ;
+  if( !ring )
+  {
+    std::lock_guard<std::mutex> lock( rings_mutex ) ;
+    if( free_rings.empty() )
+    {
+      rings.push_back( std::unique_ptr<Ring>( new Ring( (int)rings.size() ) ) ) ;
+      ring = rings.back().get() ;
+    }
+    else
+    {
+      ring = free_rings.back() ;
+      free_rings.pop_back() ;
+    }
+    holder.ring = ring ;
+  }
+
+  const uint64_t n = ring->count.load( std::memory_order_relaxed ) ;
+  Span &s = ring->spans[ n & ( CAPACITY - 1 ) ] ;
+  s.name  = name ;
+  s.begin = begin ;
+  s.end   = end ;
+  ring->count.store( n + 1, std::memory_order_release ) ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// Chrome trace export
+bool Trace::dump( const char *fn )
+//-----------------------------------------------------------------------------
+{
+  FILE *fp = fopen( fn, "w" ) ;
+  if( !fp )
+  {
+    printf( "Trace::dump error : cannot create %s\n", fn ) ;
+    return false ;
+  }
+
+#ifndef WIN32
+  const int pid = (int)getpid() ;
+#else  // WIN32
+  const int pid = 0 ;
+#endif // WIN32
+
+  std::lock_guard<std::mutex> lock( rings_mutex ) ;
+  fprintf( fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" ) ;
+  bool first = true ;
+  for( const std::unique_ptr<Ring> &r : rings )
+  {
+    fprintf( fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+             first ? "" : ",", pid, r->slot, r->slot ) ;
+    first = false ;
+
+    // the last CAPACITY spans, oldest first, in microseconds
+    const uint64_t n = r->count.load( std::memory_order_acquire ) ;
+    for( uint64_t i = n > CAPACITY ? n - CAPACITY : 0 ; i < n ; ++i )
+    {
+      const Span &s = r->spans[ i & ( CAPACITY - 1 ) ] ;
+      fprintf( fp, ",\n{\"name\":\"%s\",\"cat\":\"mc\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+               s.name, s.begin * 1e-3, ( s.end - s.begin ) * 1e-3, pid, r->slot ) ;
+    }
+  }
+  fprintf( fp, "\n]}\n" ) ;
+
+  const bool ok = !ferror( fp ) ;
+  fclose( fp ) ;
+  if( !ok ) printf( "Trace::dump error : cannot write %s\n", fn ) ;
+  return ok ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// forgets the spans
+void Trace::clear()
+//-----------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock( rings_mutex ) ;
+  for( const std::unique_ptr<Ring> &r : rings ) r->count.store( 0, std::memory_order_relaxed ) ;
+}
+//_____________________________________________________________________________
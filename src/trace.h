@@ -0,0 +1,106 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// Trace
+// Timed spans exported as Chrome trace events
+//
+//________________________________________________
+
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+#include <atomic>
+
+//_____________________________________________________________________________
+// Compilation switch
+/** records the spans of MC_TRACE_SPAN when defined to 1 and enabled by Trace::enable, otherwise they are compiled out */
+#ifndef MC_TRACE
+#define MC_TRACE 1
+#endif // MC_TRACE
+
+#define MC_TRACE_CAT2( a, b ) a##b
+#define MC_TRACE_CAT( a, b )  MC_TRACE_CAT2( a, b )
+#if MC_TRACE
+/** times the enclosing scope, name being a string literal */
+#define MC_TRACE_SPAN( name ) TraceSpan MC_TRACE_CAT( _trace_span_, __LINE__ )( name )
+#else  // MC_TRACE
+#define MC_TRACE_SPAN( name ) {}
+#endif // MC_TRACE
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// Span recorder
+/** \class Trace
+  * \brief Records timed spans in a ring buffer per thread, written by its thread only without lock, and dumps them
+  * as Chrome trace events, to be opened in chrome://tracing or Perfetto. The oldest spans of a thread are
+  * overwritten once its ring is full, and the ring of a thread that ends is taken over by the next thread, so that
+  * there are no more rings than threads recording at once. The dump should be made once the traced threads are idle.
+  */
+class Trace
+//-----------------------------------------------------------------------------
+{
+//-----------------------------------------------------------------------------
+// Constructors
+public :
+  /** spans kept per thread, a power of 2 */
+  enum { CAPACITY = 1 << 16 } ;
+
+//-----------------------------------------------------------------------------
+// Operations
+public :
+  /** starts or stops the recording */
+  static void enable( bool on = true ) ;
+  /** true while recording */
+  static inline bool enabled() { return _enabled.load( std::memory_order_relaxed ) ; }
+
+  /** nanoseconds since the first call */
+  static uint64_t now() ;
+  /** records a span of the calling thread, name being a string literal */
+  static void record( const char *name, uint64_t begin, uint64_t end ) ;
+
+  /**
+   * writes the recorded spans of all the threads
+   * \param fn name of the JSON file to create
+   * \return false if the file could not be written
+   */
+  static bool dump( const char *fn ) ;
+  /** forgets the recorded spans */
+  static void clear() ;
+
+//-----------------------------------------------------------------------------
+// Elements
+private :
+  static std::atomic<bool> _enabled ;  /**< recording switch */
+};
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// Scoped span
+/** \class TraceSpan
+  * \brief Records the span of its lifetime while the recording is enabled
+  */
+class TraceSpan
+//-----------------------------------------------------------------------------
+{
+public :
+  TraceSpan( const char *name ) : _name( Trace::enabled() ? name : 0 ), _begin( _name ? Trace::now() : 0 ) {}
+  ~TraceSpan() { if( _name ) Trace::record( _name, _begin, Trace::now() ) ; }
+
+private :
+  TraceSpan( const TraceSpan & ) ;
+  TraceSpan &operator=( const TraceSpan & ) ;
+
+  const char *_name  ;  /**< name of the span, null when not recorded */
+  uint64_t    _begin ;  /**< start of the span */
+};
+//_____________________________________________________________________________
+
+
+#endif // _TRACE_H_
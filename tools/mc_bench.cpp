@@ -0,0 +1,288 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// Benchmark
+// Phases of the extraction on the example functions
+//
+//________________________________________________
+//
+// Runs the implicit functions of fun_def and a few CSG trees on cubic grids, with the topological and the
+// original tables, and reports for each of the sampling, intersection, tesselation and export phases the wall
+// time, the cells and triangles per second and the peak resident memory, as JSON.
+//
+// Usage : mc_bench [-sizes 64,128,...] [-max 1024] [-json file] [-noexport]
+//
+// Built by tools/Makefile : make -C tools mc_bench
+//________________________________________________
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#ifndef WIN32
+#include <unistd.h>
+#include <sys/resource.h>
+#endif // WIN32
+#include "MarchingCubes.h"
+#include "csg.h"
+#include "csg_program.h"
+#include "fparser.h"
+#include "glui_defs.h"
+
+
+//_____________________________________________________________________________
+// phases of an extraction
+enum { SAMPLING, INTERSECTION, TESSELATION, EXPORT, NPHASES } ;
+static const char *phase_names[NPHASES] = { "sampling", "intersection", "tesselation", "export" } ;
+
+// CSG samples, in the format of CSG_Node::parse
+static const char *csg_list[] = { "CSG Spheres", "CSG Drilled block", "CSG Torus" } ;
+static const char *csg_def [] =
+{
+  "U s -0.3 0 0 0.45 s 0.3 0.1 0 0.45",
+  "/ b -0.6 -0.6 -0.6 0.6 0.6 0.6 U c 0 0 0 0.3 -1 1 c 0.3 0.3 0 0.15 -1 1",
+  "t 0 0 0 0.2 0.6 0",
+} ;
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// Marching cubes with its phases exposed
+class BenchCubes : public MarchingCubes
+//-----------------------------------------------------------------------------
+{
+public :
+  /** classification and vertices on the edges */
+  void intersect( real iso ) { compute_signs( iso ) ;  compute_intersection_points( iso ) ; }
+  using MarchingCubes::tesselate ;
+};
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// peak resident memory
+//-----------------------------------------------------------------------------
+
+// restarts the peak from the current resident memory, when the system allows it
+static void reset_peak()
+{
+#ifdef __linux__
+  FILE *fp = fopen( "/proc/self/clear_refs", "w" ) ;
+  if( fp ) { fputs( "5", fp ) ;  fclose( fp ) ; }
+#endif // __linux__
+}
+
+// peak resident memory in kB since the last reset_peak, or since the start of the process
+static long peak_kb()
+{
+#ifdef __linux__
+  FILE *fp = fopen( "/proc/self/status", "r" ) ;
+  if( fp )
+  {
+    char line[256] ;
+    long kb = -1 ;
+    while( fgets( line, sizeof(line), fp ) )
+      if( !strncmp( line, "VmHWM:", 6 ) ) kb = atol( line + 6 ) ;
+    fclose( fp ) ;
+    if( kb >= 0 ) return kb ;
+  }
+#endif // __linux__
+#ifndef WIN32
+  struct rusage ru ;
+  getrusage( RUSAGE_SELF, &ru ) ;
+#ifdef __APPLE__
+  return ru.ru_maxrss / 1024 ;
+#else  // __APPLE__
+  return ru.ru_maxrss ;
+#endif // __APPLE__
+#else  // WIN32
+  return -1 ;
+#endif // WIN32
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// measures of a phase
+struct Measure { double secs ; long peak ; } ;
+
+// runs a phase
+template< typename F > static Measure measure( F f )
+{
+  reset_peak() ;
+  const auto t0 = std::chrono::steady_clock::now() ;
+  f() ;
+  const auto t1 = std::chrono::steady_clock::now() ;
+  Measure m = { std::chrono::duration<double>( t1 - t0 ).count(), peak_kb() } ;
+  return m ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// samples a formula or a CSG tree on [-1,1]^3
+static bool sample( BenchCubes &mc, int n, const char *formula, const CSG_Program *csg )
+//-----------------------------------------------------------------------------
+{
+  const float r = 2.0f / ( n - 1 ) ;
+  mc.set_resolution( n, n, n ) ;
+  mc.init_all() ;
+
+  if( csg )
+  {
+    // x slabs, as the graphical interface
+    std::vector<float> slab( (size_t)n * n ) ;
+    for( int i = 0 ; i < n ; ++i )
+    {
+      const float org [3] = { (float)i * r - 1.0f, -1.0f, -1.0f } ;
+      const float step[3] = { r, r, r } ;
+      const int   m   [3] = { 1, n, n } ;
+      csg->sample( org, step, m, slab.data() ) ;
+      for( int j = 0 ; j < n ; ++j )
+      for( int k = 0 ; k < n ; ++k )
+        mc.set_data( slab[ k + n * j ], i,j,k ) ;
+    }
+    return true ;
+  }
+
+  FunctionParser fparser ;
+  if( fparser.Parse( formula, "x,y,z,c,i" ) >= 0 ) return false ;
+  float pt[5] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f } ;
+  for( int k = 0 ; k < n ; ++k )
+  for( int j = 0 ; j < n ; ++j )
+  for( int i = 0 ; i < n ; ++i )
+  {
+    pt[X] = (float)i * r - 1.0f ;
+    pt[Y] = (float)j * r - 1.0f ;
+    pt[Z] = (float)k * r - 1.0f ;
+    mc.set_data( fparser.Eval( pt ), i,j,k ) ;
+  }
+  return true ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// main
+int main( int argc, char *argv[] )
+//-----------------------------------------------------------------------------
+{
+  std::vector<int> sizes ;
+  int         max_size = 1024 ;
+  const char *json_fn  = NULL ;
+  bool        do_export = true ;
+  for( int a = 1 ; a < argc ; ++a )
+  {
+    if( !strcmp( argv[a], "-sizes" ) && a+1 < argc )
+    {
+      for( char *s = strtok( argv[++a], "," ) ; s ; s = strtok( NULL, "," ) ) sizes.push_back( atoi( s ) ) ;
+    }
+    else if( !strcmp( argv[a], "-max"  ) && a+1 < argc ) max_size = atoi( argv[++a] ) ;
+    else if( !strcmp( argv[a], "-json" ) && a+1 < argc ) json_fn  = argv[++a] ;
+    else if( !strcmp( argv[a], "-noexport" ) ) do_export = false ;
+    else
+    {
+      printf( "usage : %s [-sizes 64,128,...] [-max 1024] [-json file] [-noexport]\n", argv[0] ) ;
+      return 1 ;
+    }
+  }
+  if( sizes.empty() )
+    for( int n = 64 ; n <= max_size ; n *= 2 ) sizes.push_back( n ) ;
+
+  FILE *json = json_fn ? fopen( json_fn, "w" ) : stdout ;
+  if( !json )
+  {
+    printf( "mc_bench error : cannot create %s\n", json_fn ) ;
+    return 1 ;
+  }
+
+  // the example functions, without the formula template, then the CSG trees
+  struct Case { std::string name ; const char *formula ; CSG_Node *root ; } ;
+  std::vector<Case> cases ;
+  for( int f = 1 ; f < NFUNS ; ++f )
+  {
+    Case c = { fun_list[f], fun_def[f], NULL } ;
+    cases.push_back( c ) ;
+  }
+  for( size_t t = 0 ; t < sizeof(csg_def) / sizeof(csg_def[0]) ; ++t )
+  {
+    FILE *fp = tmpfile() ;
+    if( !fp ) continue ;
+    fputs( csg_def[t], fp ) ;
+    rewind( fp ) ;
+    Case c = { csg_list[t], "c", CSG_Node::parse( fp ) } ;
+    fclose( fp ) ;
+    cases.push_back( c ) ;
+  }
+
+  char ply_fn[64] ;
+#ifndef WIN32
+  snprintf( ply_fn, sizeof(ply_fn), "mc_bench_%d.ply", (int)getpid() ) ;
+#else  // WIN32
+  strcpy( ply_fn, "mc_bench.ply" ) ;
+#endif // WIN32
+
+  fprintf( json, "{\n  \"benchmark\": \"mc_bench\",\n  \"results\": [" ) ;
+  bool first = true ;
+  for( const Case &c : cases )
+  {
+    CSG_Program csg( c.root ) ;
+    for( int n : sizes )
+    {
+      if( n < 2 ) continue ;
+      BenchCubes mc ;
+      bool ok = true ;
+      const Measure sampling = measure( [&]{ ok = sample( mc, n, c.formula, c.root ? &csg : NULL ) ; } ) ;
+      if( !ok )
+      {
+        fprintf( stderr, "mc_bench error : cannot parse %s\n", c.formula ) ;
+        break ;
+      }
+
+      for( int original = 0 ; original < 2 ; ++original )
+      {
+        // second run on the same samples
+        mc.reset() ;
+        mc.set_method( original == 1 ) ;
+
+        Measure m[NPHASES] ;
+        m[SAMPLING    ] = sampling ;
+        m[INTERSECTION] = measure( [&]{ mc.intersect( 0.0f ) ; } ) ;
+        m[TESSELATION ] = measure( [&]{ mc.tesselate( 0.0f ) ; } ) ;
+        m[EXPORT      ] = measure( [&]{ if( do_export ) mc.writePLY( ply_fn ) ; } ) ;
+        if( do_export ) remove( ply_fn ) ;
+
+        const double cells = (double)( n-1 ) * ( n-1 ) * ( n-1 ) ;
+        fprintf( stderr, "%-20s %5d^3 %-11s", c.name.c_str(), n, original ? "original" : "topological" ) ;
+        fprintf( json, "%s\n    { \"function\": \"%s\", \"kind\": \"%s\", \"size\": %d, \"method\": \"%s\", \"cells\": %.0f, \"vertices\": %d, \"triangles\": %d,\n      \"phases\": {",
+                 first ? "" : ",", c.name.c_str(), c.root ? "csg" : "formula", n, original ? "original" : "topological", cells, mc.nverts(), mc.ntrigs() ) ;
+        first = false ;
+        for( int p = 0 ; p < NPHASES ; ++p )
+        {
+          if( p == EXPORT && !do_export ) continue ;
+          const double s = m[p].secs > 0 ? m[p].secs : 1e-9 ;
+          fprintf( json, "%s\n        \"%s\": { \"wall_s\": %.6f, \"cells_per_s\": %.1f, \"triangles_per_s\": %.1f, \"peak_rss_kb\": %ld }",
+                   p ? "," : "", phase_names[p], m[p].secs, cells / s, mc.ntrigs() / s, m[p].peak ) ;
+          fprintf( stderr, "  %s %.3fs", phase_names[p], m[p].secs ) ;
+        }
+        fprintf( json, "\n      } }" ) ;
+        fprintf( stderr, "  %d triangles\n", mc.ntrigs() ) ;
+      }
+    }
+    delete c.root ;
+  }
+  fprintf( json, "\n  ]\n}\n" ) ;
+
+  if( json != stdout ) fclose( json ) ;
+  return 0 ;
+}
+//_____________________________________________________________________________
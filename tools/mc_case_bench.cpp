@@ -0,0 +1,177 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// Case benchmark
+// Cost of each tesselation path of process_cube
+//
+//________________________________________________
+//
+// Draws random corner values for each of the 256 sign configurations, sorts them by the path they take through
+// process_cube (the subconfigurations of the case 13, the face and interior tests of the other ambiguous cases), and
+// times process_cube alone on each path, in nanoseconds per cube. The paths reached are summed up by case at the end :
+// with the topological tables, 6.1.2, 12.1.2 and 13.5.2 are not reached by any draw, the interior test of these
+// cases always taking the other branch.
+//
+// Usage : mc_case_bench [-original] [-draws 20000] [-ms 20] [-seed 1]
+//
+// Built by tools/Makefile : make -C tools mc_case_bench
+//________________________________________________
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <chrono>
+#include <random>
+#include "MarchingCubes.h"
+#include "LookUpTable.h"
+
+
+//_____________________________________________________________________________
+// Marching cubes on a single cube, its tesselation exposed
+class CaseCubes : public MarchingCubes
+//-----------------------------------------------------------------------------
+{
+public :
+  /** path of process_cube through the tests */
+  struct Path { int ntrigs ; bool cvertex ; int subconfig ; int subcase13 ; } ;
+
+  CaseCubes( bool original ) : MarchingCubes( 2, 2, 2 ) { set_method( original ) ; }
+
+  /** computes the vertices of the edges of the cube, for the sign configuration of cube */
+  void setup( const float *cube )
+  {
+    init_all() ;
+    for( int p = 0 ; p < 8 ; ++p ) set_data( cube[p], (p^(p>>1))&1, (p>>1)&1, (p>>2)&1 ) ;
+    compute_signs( 0.0f ) ;
+    compute_intersection_points( 0.0f ) ;
+    _base = nverts() ;
+    _i = _j = _k = 0 ;
+  }
+
+  /** tesselates cube, of the configuration given to setup */
+  inline void tesselate_cube( float *cube, uchar entry ) { _lut_entry = entry ;  process_cube( cube ) ; }
+  /** forgets the triangles and the interior vertices of the previous tesselations */
+  inline void reset() { _triangles.clear() ;  _vertices.resize( _base ) ; }
+
+  /** path taken by cube */
+  Path path( float *cube, uchar entry )
+  {
+    reset() ;
+    tesselate_cube( cube, entry ) ;
+    Path p = { ntrigs(), nverts() > _base, _subconfig, -1 } ;
+    if( !_originalMC && cases[entry][0] == 13 )
+    {
+      // 13.1 ... 13.4 from the face tests, 13.5.1 and 13.5.2 by their number of triangles
+      int mask = 0 ;
+      for( int f = 0 ; f < 6 ; ++f ) if( test_face( test13[ (int)cases[entry][1] ][f], cube ) ) mask |= 1 << f ;
+      const int s = subconfig13[mask] ;
+      p.subcase13 = ( s == 0 || s == 45 ) ? MCStats::S13_1 : ( s <= 6 || s >= 39 ) ? MCStats::S13_2 :
+                    ( s <= 18 || s >= 27 ) ? MCStats::S13_3 : s <= 22 ? MCStats::S13_4 :
+                    p.ntrigs == 6 ? MCStats::S13_5_1 : MCStats::S13_5_2 ;
+    }
+    reset() ;
+    return p ;
+  }
+
+private :
+  int _base ;  /**< vertices on the edges of the cube */
+};
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// main
+int main( int argc, char *argv[] )
+//-----------------------------------------------------------------------------
+{
+  bool   original = false ;
+  int    draws    = 20000 ;
+  double ms       = 20.0 ;
+  int    seed     = 1 ;
+  for( int a = 1 ; a < argc ; ++a )
+  {
+    if     ( !strcmp( argv[a], "-original" ) ) original = true ;
+    else if( !strcmp( argv[a], "-draws" ) && a+1 < argc ) draws = atoi( argv[++a] ) ;
+    else if( !strcmp( argv[a], "-ms"    ) && a+1 < argc ) ms    = atof( argv[++a] ) ;
+    else if( !strcmp( argv[a], "-seed"  ) && a+1 < argc ) seed  = atoi( argv[++a] ) ;
+    else
+    {
+      printf( "usage : %s [-original] [-draws 20000] [-ms 20] [-seed 1]\n", argv[0] ) ;
+      return 1 ;
+    }
+  }
+
+  static const char *subcase_names[MCStats::N13] = { "13.1", "13.2", "13.3", "13.4", "13.5.1", "13.5.2" } ;
+  enum { POOL = 64 } ;
+  std::mt19937 rng( seed ) ;
+  std::uniform_real_distribution<float> mag( 0.0f, 1.0f ) ;
+
+  CaseCubes mc( original ) ;
+  std::map< int, std::set<std::string> > reached ;
+  printf( "%-5s %-5s %-8s %6s %8s %10s\n", "entry", "case", "path", "trigs", "cubes", "ns/cube" ) ;
+  for( int entry = 0 ; entry < 256 ; ++entry )
+  {
+    // corner values of the signs of the entry, the magnitudes spread over several scales to reach the saddles
+    std::map< std::string, std::vector< std::vector<float> > > pools ;
+    std::map< std::string, CaseCubes::Path > paths ;
+    std::vector<float> cube( 8 ) ;
+    const int ndraws = ( entry == 0 || entry == 255 ) ? 1 : draws ;
+    for( int d = 0 ; d < ndraws ; ++d )
+    {
+      for( int p = 0 ; p < 8 ; ++p )
+      {
+        float m = 0.01f + mag( rng ) ;
+        if( d & 1 ) m = m * m * m ;
+        cube[p] = ( entry >> p ) & 1 ? m : -m ;
+      }
+      if( d == 0 ) mc.setup( cube.data() ) ;
+      const CaseCubes::Path p = mc.path( cube.data(), (uchar)entry ) ;
+
+      char key[32] ;
+      if( p.subcase13 >= 0 ) snprintf( key, sizeof(key), "%s", subcase_names[p.subcase13] ) ;
+      else                   snprintf( key, sizeof(key), "%d%s/%d", p.ntrigs, p.cvertex ? "+c" : "", p.subconfig ) ;
+      std::vector< std::vector<float> > &pool = pools[key] ;
+      if( pool.size() < POOL ) pool.push_back( cube ) ;
+      paths[key] = p ;
+      reached[ original ? -1 : (int)cases[entry][0] ].insert( key ) ;
+    }
+
+    // each path timed on its pool for at least ms milliseconds
+    for( auto &kv : pools )
+    {
+      std::vector< std::vector<float> > &pool = kv.second ;
+      size_t ncubes = 0 ;
+      double secs   = 0.0 ;
+      while( secs * 1e3 < ms )
+      {
+        const auto t0 = std::chrono::steady_clock::now() ;
+        for( int r = 0 ; r < 16 ; ++r )
+        {
+          for( std::vector<float> &c : pool ) mc.tesselate_cube( c.data(), (uchar)entry ) ;
+          mc.reset() ;
+        }
+        secs   += std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count() ;
+        ncubes += 16 * pool.size() ;
+      }
+      printf( "%-5d %-5d %-8s %6d %8lu %10.2f\n", entry, original ? -1 : (int)cases[entry][0], kv.first.c_str(),
+              paths[kv.first].ntrigs, (unsigned long)ncubes, secs * 1e9 / ncubes ) ;
+    }
+  }
+
+  // paths reached by case
+  for( auto &kv : reached )
+  {
+    printf( "case %d :", kv.first ) ;
+    for( const std::string &key : kv.second ) printf( " %s", key.c_str() ) ;
+    printf( "\n" ) ;
+  }
+  return 0 ;
+}
+//_____________________________________________________________________________
@@ -0,0 +1,97 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// Extraction
+// Headless isosurface extraction from the command line
+//
+//________________________________________________
+//
+// Samples an implicit formula, a CSG tree or an ISO or raw volume on a grid, extracts the isosurface of each
+// isovalue and writes it as a binary PLY or STL mesh, without any graphical interface. The options are those of
+// parse_cmdline, listed by -help. With several isovalues, the index of the isovalue is inserted before the extension
+// of the mesh file, and each mesh is written by a thread while the next isovalue is extracted. The trace of -trace
+// covers all the isovalues and the writes, dumped once the last mesh is written.
+//
+// Usage : mc_extract -fun Sphere -res 128 -isoval 0,0.1 -threads 8 -o sphere.ply
+//
+// Built by tools/Makefile : make -C tools mc_extract
+//________________________________________________
+
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include "MarchingCubes.h"
+#include "mesh_io.h"
+#include "trace.h"
+#include "glui_defs.h"
+
+
+//_____________________________________________________________________________
+// main
+int main( int argc, char *argv[] )
+//-----------------------------------------------------------------------------
+{
+  if( !parse_cmdline( argc, argv ) ) return 1 ;
+
+  const std::string out  = mesh_out_filename ;
+  const size_t      dot  = out.find_last_of( '.' ) ;
+  const size_t      base = ( dot == std::string::npos || out.find_last_of( '/' ) + 1 > dot ) ? out.size() : dot ;
+  if( pipelined && out.empty() ) printf( "no mesh file : the pipeline runs without -o as a plain extraction\n" ) ;
+
+  // one trace of all the runs and writes, taken from run which would restart it for each isovalue
+  const std::string trace = trace_filename ;
+  trace_filename[0] = '\0' ;
+  if( !trace.empty() ) Trace::enable() ;
+
+  // writing of the previous mesh, which owns its buffers
+  std::thread writer ;
+  int failures = 0, write_failures = 0 ;
+  for( size_t n = 0 ; n < isovals.size() ; ++n )
+  {
+    isoval = isovals[n] ;
+
+    // mesh file of the isovalue
+    std::string fn = out ;
+    if( isovals.size() > 1 && !fn.empty() ) fn.insert( base, "_" + std::to_string( n ) ) ;
+    snprintf( mesh_out_filename, sizeof(mesh_out_filename), "%s", fn.c_str() ) ;
+
+    const bool ok = run() ;
+    // the field is the same for all the isovalues : exported once
+    export_iso = 0 ;
+    if( !ok )
+    {
+      printf( "extraction failed for the isovalue %g\n", isoval ) ;
+      ++failures ;
+      continue ;
+    }
+    if( pipelined && !fn.empty() ) continue ;
+
+    printf( "isovalue %g : %d vertices, %d triangles\n", isoval, mc.nverts(), mc.ntrigs() ) ;
+    if( fn.empty() ) continue ;
+
+    if( writer.joinable() ) writer.join() ;
+    writer = std::thread( [fn, &write_failures]( const MCMesh &m )
+    {
+      if( !MeshWriter::write( fn.c_str(), mesh_stl ? MeshWriter::STL : MeshWriter::PLY, m.vertices.data(), m.vertices.size(), m.triangles.data(), m.triangles.size() ) )
+      {
+        printf( "cannot write %s\n", fn.c_str() ) ;
+        ++write_failures ;
+      }
+      else
+        printf( "wrote %s\n", fn.c_str() ) ;
+    }, mc.take_mesh() ) ;
+  }
+  if( writer.joinable() ) writer.join() ;
+
+  if( !trace.empty() )
+  {
+    Trace::enable( false ) ;
+    if( !Trace::dump( trace.c_str() ) ) ++write_failures ;
+  }
+
+  return failures + write_failures ? 1 : 0 ;
+}
+//_____________________________________________________________________________
@@ -0,0 +1,447 @@
+//------------------------------------------------
+// MarchingCubes
+//------------------------------------------------
+//
+// Differential fuzzer
+// Extraction engines checked against the reference tesselation
+//
+//________________________________________________
+//
+// Draws random and adversarial volumes : uniform noise, small integer values with exact ties in the face and
+// interior tests, values within a few epsilons of the isovalue, products of sines full of saddles, and spheres.
+// Each volume is tesselated by the reference scalar loops over all the samples and cubes, then by the engines of the
+// library : run, run_seeded, BrickExtractor, MeshPipeline and DistributedExtractor. The meshes of the engines must have
+// the vertices and triangles of the reference, whatever their order and the first vertex of each triangle, and the
+// normals of the reference vertices at the same positions, up to a small tolerance. With the topological
+// tables, every mesh must also be an oriented manifold whose open edges lie on the border of the grid, closed when
+// the border of the volume is positive, and of the Euler characteristic of the reference, 2 for the spheres.
+// When the reference itself fails these checks, the defect is reported apart and the engines are only compared to it :
+// the near-zero volumes find such defects, all their face tests falling below the absolute tie threshold of
+// test_face and being broken differently by the two cubes of a face.
+//
+// Each iteration draws its volume from the seed plus its index : a failure prints the options replaying it alone.
+//
+// Usage : mc_fuzz [-iters 500] [-seed 1] [-max 24] [-tmp mc_fuzz.ply] [-v]
+//
+// Built by tools/Makefile : make -C tools mc_fuzz
+//________________________________________________
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <array>
+#include <map>
+#include <random>
+#include <algorithm>
+#include "MarchingCubes.h"
+#include "brick_scheduler.h"
+#include "pipeline.h"
+#include "distributed.h"
+#include "mesh_io.h"
+
+
+//_____________________________________________________________________________
+// kinds of volumes
+enum { NOISE, TIES, NEAR_ZERO, SADDLES, SPHERE, NKINDS } ;
+static const char *kind_names[NKINDS] = { "noise", "ties", "near-zero", "saddles", "sphere" } ;
+
+// values of the volumes with ties, around the isovalue
+static const float tie_values[] = { -2.0f, -1.0f, -0.5f, 0.0f, 0.5f, 1.0f, 2.0f } ;
+
+// largest difference of a normal component to the reference
+static const float normal_tolerance = 1e-5f ;
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// Reference marching cubes
+class RefCubes : public MarchingCubes
+//-----------------------------------------------------------------------------
+{
+public :
+  /** tesselation by the scalar loops over all the samples and all the cubes, without classification nor bricks */
+  void reference( real iso )
+  {
+    const float eps = std::numeric_limits<float>::epsilon() ;
+    for( int k = 0 ; k < _size_z ; ++k )
+    for( int j = 0 ; j < _size_y ; ++j )
+    for( int i = 0 ; i < _size_x ; ++i )
+    {
+      const glm::ivec3 g( i, j, k ) ;
+      float cube[8] ;
+      cube[0] = get_data( g ) - iso ;
+      cube[1] = i < _size_x - 1 ? get_data( glm::ivec3( i+1, j, k ) ) - iso : cube[0] ;
+      cube[3] = j < _size_y - 1 ? get_data( glm::ivec3( i, j+1, k ) ) - iso : cube[0] ;
+      cube[4] = k < _size_z - 1 ? get_data( glm::ivec3( i, j, k+1 ) ) - iso : cube[0] ;
+      for( int p : { 0, 1, 3, 4 } ) if( std::abs( cube[p] ) < eps ) cube[p] = eps ;
+      if( ( cube[0] < 0 ) != ( cube[1] < 0 ) ) set_x_vert( add_vertex( g, glm::ivec3( 1, 0, 0 ), 1, cube ), i,j,k ) ;
+      if( ( cube[0] < 0 ) != ( cube[3] < 0 ) ) set_y_vert( add_vertex( g, glm::ivec3( 0, 1, 0 ), 3, cube ), i,j,k ) ;
+      if( ( cube[0] < 0 ) != ( cube[4] < 0 ) ) set_z_vert( add_vertex( g, glm::ivec3( 0, 0, 1 ), 4, cube ), i,j,k ) ;
+    }
+
+    for( _k = 0 ; _k < _size_z-1 ; _k++ )
+    for( _j = 0 ; _j < _size_y-1 ; _j++ )
+    for( _i = 0 ; _i < _size_x-1 ; _i++ )
+    {
+      float cube[8] ;
+      load_cube( cube, iso ) ;
+      process_cube( cube ) ;
+    }
+  }
+};
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// Mesh under test
+struct Mesh
+//-----------------------------------------------------------------------------
+{
+  MCBuffer<Vertex>      verts ;
+  MCBuffer<Triangle>    trigs ;
+
+  /** copies the mesh of mc */
+  void assign( MarchingCubes &mc )
+  {
+    verts.assign( mc.vertices (), mc.vertices () + mc.nverts() ) ;
+    trigs.assign( mc.triangles(), mc.triangles() + mc.ntrigs() ) ;
+  }
+} ;
+
+// position of a vertex
+typedef std::array<float,3> Point ;
+static inline Point point ( const Vertex &v ) { Point p = {{ v.x,  v.y,  v.z  }} ; return p ; }
+static inline Point normal( const Vertex &v ) { Point n = {{ v.nx, v.ny, v.nz }} ; return n ; }
+
+//-----------------------------------------------------------------------------
+// sorted positions of the vertices, and of the triangles starting from their smallest vertex
+static void canonical( const Mesh &m, std::vector<Point> &verts, std::vector< std::array<Point,3> > &trigs )
+{
+  verts.clear() ;
+  for( const Vertex &v : m.verts ) verts.push_back( point( v ) ) ;
+  std::sort( verts.begin(), verts.end() ) ;
+
+  trigs.clear() ;
+  for( const Triangle &t : m.trigs )
+  {
+    std::array<Point,3> c = {{ point( m.verts[t.v1] ), point( m.verts[t.v2] ), point( m.verts[t.v3] ) }} ;
+    const int first = ( c[1] < c[0] && c[1] < c[2] ) ? 1 : ( c[2] < c[0] && c[2] < c[1] ) ? 2 : 0 ;
+    std::rotate( c.begin(), c.begin() + first, c.end() ) ;
+    trigs.push_back( c ) ;
+  }
+  std::sort( trigs.begin(), trigs.end() ) ;
+}
+
+//-----------------------------------------------------------------------------
+// checks the normals of the vertices against those of the reference at the same position, the closest one when
+// several vertices coincide, the undefined normals of a null gradient matching each other ; returns an empty string
+// or the first normal out of the tolerance
+static std::string check_normals( const Mesh &m, const std::vector< std::pair<Point,Point> > &ref )
+{
+  char msg[256] ;
+  auto diff = []( float a, float b )
+  {
+    if( std::isnan( a ) || std::isnan( b ) ) return std::isnan( a ) && std::isnan( b ) ? 0.0f : std::numeric_limits<float>::max() ;
+    return std::abs( a - b ) ;
+  } ;
+  for( const Vertex &v : m.verts )
+  {
+    const Point p = point( v ), n = normal( v ) ;
+    auto r = std::equal_range( ref.begin(), ref.end(), std::make_pair( p, Point() ),
+                               []( const std::pair<Point,Point> &a, const std::pair<Point,Point> &b ) { return a.first < b.first ; } ) ;
+    float best = std::numeric_limits<float>::max() ;
+    Point closest = {{ 0, 0, 0 }} ;
+    for( ; r.first != r.second ; ++r.first )
+    {
+      const Point &q = r.first->second ;
+      const float d = std::max( diff( n[0], q[0] ), std::max( diff( n[1], q[1] ), diff( n[2], q[2] ) ) ) ;
+      if( d < best ) { best = d ;  closest = q ; }
+    }
+    if( best > normal_tolerance )
+    {
+      snprintf( msg, sizeof(msg), "normal (%g %g %g) instead of (%g %g %g) at (%g %g %g)", n[0], n[1], n[2],
+                closest[0], closest[1], closest[2], p[0], p[1], p[2] ) ;
+      return msg ;
+    }
+  }
+  return "" ;
+}
+
+//-----------------------------------------------------------------------------
+// checks that the mesh is an oriented manifold, open only on the border of the grid, and computes its Euler
+// characteristic ; returns an empty string or the first defect found
+static std::string check_manifold( const Mesh &m, const glm::ivec3 &size, bool closed, int &euler )
+{
+  char msg[256] ;
+  std::map< std::pair<int,int>, int > edges ;  // directed edge -> number of triangles
+  std::vector<char> used( m.verts.size(), 0 ) ;
+  for( const Triangle &t : m.trigs )
+  {
+    const int v[3] = { t.v1, t.v2, t.v3 } ;
+    for( int e = 0 ; e < 3 ; ++e )
+    {
+      if( v[e] < 0 || v[e] >= (int)m.verts.size() ) return "vertex index out of range" ;
+      if( v[e] == v[(e+1)%3] ) return "triangle with a repeated vertex" ;
+      used[ v[e] ] = 1 ;
+      if( ++edges[ std::make_pair( v[e], v[(e+1)%3] ) ] > 1 )
+      {
+        snprintf( msg, sizeof(msg), "edge %d-%d oriented twice the same way", v[e], v[(e+1)%3] ) ;
+        return msg ;
+      }
+    }
+  }
+
+  // the edges without opposite are borders, on a face of the grid
+  size_t nedges = 0 ;
+  for( const auto &kv : edges )
+  {
+    const int a = kv.first.first, b = kv.first.second ;
+    const bool twin = edges.count( std::make_pair( b, a ) ) != 0 ;
+    if( twin ) { if( a < b ) ++nedges ;  continue ; }
+    ++nedges ;
+    const Point pa = point( m.verts[a] ), pb = point( m.verts[b] ) ;
+    bool border = false ;
+    for( int c = 0 ; c < 3 ; ++c )
+      border |= ( pa[c] == 0 && pb[c] == 0 ) || ( pa[c] == size[c]-1 && pb[c] == size[c]-1 ) ;
+    if( closed || !border )
+    {
+      snprintf( msg, sizeof(msg), "open edge %d-%d at (%g %g %g)-(%g %g %g)", a, b, pa[0], pa[1], pa[2], pb[0], pb[1], pb[2] ) ;
+      return msg ;
+    }
+  }
+
+  euler = (int)std::count( used.begin(), used.end(), 1 ) - (int)nedges + (int)m.trigs.size() ;
+  if( closed && ( euler & 1 ) ) return "odd Euler characteristic of a closed mesh" ;
+  return "" ;
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// volume of an iteration
+static void draw_volume( std::mt19937 &rng, int max, int &kind, glm::ivec3 &size, std::vector<float> &data, real &iso, bool &closed )
+{
+  std::uniform_real_distribution<float> unit( -1.0f, 1.0f ) ;
+  const float eps = std::numeric_limits<float>::epsilon() ;
+  const int ntie = sizeof(tie_values) / sizeof(tie_values[0]) ;
+
+  // rows sometimes across a word of the sign planes
+  kind = rng() % NKINDS ;
+  for( int a = 0 ; a < 3 ; ++a ) size[a] = 2 + rng() % ( max - 1 ) ;
+  if( rng() % 4 == 0 ) size.x = 62 + rng() % 6 ;
+
+  iso = 0 ;
+  if( kind == TIES && rng() % 2 ) iso = tie_values[ rng() % ntie ] ;
+  const glm::vec3 freq( 0.3f + 1.2f * ( unit( rng ) + 1 ), 0.3f + 1.2f * ( unit( rng ) + 1 ), 0.3f + 1.2f * ( unit( rng ) + 1 ) ) ;
+  const glm::vec3 centre = glm::vec3( size - 1 ) * 0.5f + glm::vec3( unit( rng ), unit( rng ), unit( rng ) ) * 0.5f ;
+  const float     radius = ( std::min( size.x, std::min( size.y, size.z ) ) - 1 ) * 0.5f * ( 0.3f + 0.3f * ( unit( rng ) + 1 ) ) ;
+
+  data.resize( (size_t)size.x * size.y * size.z ) ;
+  for( int k = 0, s = 0 ; k < size.z ; ++k )
+  for( int j = 0 ; j < size.y ; ++j )
+  for( int i = 0 ; i < size.x ; ++i, ++s )
+  {
+    float v = 0 ;
+    switch( kind )
+    {
+    case NOISE     : v = unit( rng ) ; break ;
+    case TIES      : v = tie_values[ rng() % ntie ] ; break ;
+    case NEAR_ZERO : v = (float)( (int)( rng() % 9 ) - 4 ) * 0.5f * eps + ( rng() % 8 == 0 ? unit( rng ) : 0.0f ) ; break ;
+    case SADDLES   : v = sinf( freq.x * i ) * sinf( freq.y * j ) * sinf( freq.z * k ) ; break ;
+    case SPHERE    : v = glm::length( glm::vec3( i, j, k ) - centre ) - radius ; break ;
+    }
+    data[s] = v ;
+  }
+
+  // positive border : closed meshes, the spheres being closed only when they fit in the grid
+  closed = kind == SPHERE ? false : rng() % 2 == 0 ;
+  if( kind == SPHERE && radius >= 1.0f )
+  {
+    closed = true ;
+    for( int a = 0 ; a < 3 ; ++a ) closed &= centre[a] - radius > 0.5f && centre[a] + radius < size[a] - 1.5f ;
+  }
+  else if( closed )
+  {
+    for( int k = 0, s = 0 ; k < size.z ; ++k )
+    for( int j = 0 ; j < size.y ; ++j )
+    for( int i = 0 ; i < size.x ; ++i, ++s )
+      if( i == 0 || j == 0 || k == 0 || i == size.x-1 || j == size.y-1 || k == size.z-1 ) data[s] = iso + 1.0f ;
+  }
+}
+//_____________________________________________________________________________
+
+
+
+//_____________________________________________________________________________
+// main
+int main( int argc, char *argv[] )
+//-----------------------------------------------------------------------------
+{
+  int         iters   = 500 ;
+  int         seed    = 1 ;
+  int         max     = 24 ;
+  std::string tmp     = "mc_fuzz.ply" ;
+  bool        verbose = false ;
+  for( int a = 1 ; a < argc ; ++a )
+  {
+    if     ( !strcmp( argv[a], "-iters" ) && a+1 < argc ) iters = atoi( argv[++a] ) ;
+    else if( !strcmp( argv[a], "-seed"  ) && a+1 < argc ) seed  = atoi( argv[++a] ) ;
+    else if( !strcmp( argv[a], "-max"   ) && a+1 < argc ) max   = std::max( atoi( argv[++a] ), 2 ) ;
+    else if( !strcmp( argv[a], "-tmp"   ) && a+1 < argc ) tmp   = argv[++a] ;
+    else if( !strcmp( argv[a], "-v"     ) ) verbose = true ;
+    else
+    {
+      printf( "usage : %s [-iters 500] [-seed 1] [-max 24] [-tmp mc_fuzz.ply] [-v]\n", argv[0] ) ;
+      return 1 ;
+    }
+  }
+
+  enum { RUN, SEEDED, BRICKS, PIPELINE, DISTRIBUTED, NENGINES } ;
+  static const char *engine_names[NENGINES] = { "run", "run_seeded", "BrickExtractor", "MeshPipeline", "DistributedExtractor" } ;
+  int failures = 0, defects = 0 ;
+  for( int it = 0 ; it < iters ; ++it )
+  {
+    std::mt19937 rng( seed + it ) ;
+    int kind ;
+    glm::ivec3 size ;
+    std::vector<float> data ;
+    real iso ;
+    bool closed ;
+    draw_volume( rng, max, kind, size, data, iso, closed ) ;
+    const bool original = rng() % 4 == 0 ;
+    const int  brick    = 1 + rng() % 6 ;
+    const int  slab     = 1 + rng() % 4 ;
+
+    auto fill = [&]( MarchingCubes &mc )
+    {
+      mc.set_resolution( size.x, size.y, size.z ) ;
+      mc.set_method( original ) ;
+      mc.init_all() ;
+      for( int k = 0, s = 0 ; k < size.z ; ++k )
+      for( int j = 0 ; j < size.y ; ++j )
+      for( int i = 0 ; i < size.x ; ++i, ++s )
+        mc.set_data( data[s], i,j,k ) ;
+    } ;
+    // sampling callback of the engines without grid
+    auto sample = [&]( const glm::ivec3 &first, const glm::ivec3 &stride, const glm::ivec3 &n, float *res )
+    {
+      for( int k = 0 ; k < n.z ; ++k )
+      for( int j = 0 ; j < n.y ; ++j )
+      for( int i = 0 ; i < n.x ; ++i )
+      {
+        const glm::ivec3 p = first + glm::ivec3( i, j, k ) * stride ;
+        res[ i + n.x * ( j + n.y * k ) ] = data[ p.x + size.x * ( p.y + (size_t)size.y * p.z ) ] ;
+      }
+    } ;
+    auto fail = [&]( const char *engine, const std::string &what )
+    {
+      printf( "FAIL iteration %d (%s %dx%dx%d iso %g%s%s) %s : %s\n    replay : %s -seed %d -iters 1 -max %d\n",
+              it, kind_names[kind], size.x, size.y, size.z, iso, closed ? " closed" : "", original ? " original" : "",
+              engine, what.c_str(), argv[0], seed + it, max ) ;
+      ++failures ;
+    } ;
+
+    // reference
+    RefCubes ref ;
+    fill( ref ) ;
+    ref.reference( iso ) ;
+    Mesh refm ;
+    refm.assign( ref ) ;
+    std::vector<Point> refv, v ;
+    std::vector< std::array<Point,3> > reft, t ;
+    canonical( refm, refv, reft ) ;
+    std::vector< std::pair<Point,Point> > refn ;
+    for( const Vertex &rv : refm.verts ) refn.push_back( std::make_pair( point( rv ), normal( rv ) ) ) ;
+    std::sort( refn.begin(), refn.end() ) ;
+    int ref_euler = 0 ;
+    std::string ref_defect ;
+    if( !original )
+    {
+      ref_defect = check_manifold( refm, size, closed, ref_euler ) ;
+      if( ref_defect.empty() && kind == SPHERE && closed && ref_euler != 2 )
+        ref_defect = "Euler characteristic of a sphere " + std::to_string( ref_euler ) ;
+      if( !ref_defect.empty() )
+      {
+        printf( "reference defect iteration %d (%s %dx%dx%d iso %g%s) : %s\n", it, kind_names[kind], size.x, size.y, size.z,
+                iso, closed ? " closed" : "", ref_defect.c_str() ) ;
+        ++defects ;
+      }
+    }
+
+    // engines
+    for( int e = 0 ; e < NENGINES ; ++e )
+    {
+      Mesh m ;
+      MarchingCubes mc ;
+      if( e != DISTRIBUTED ) fill( mc ) ;
+      switch( e )
+      {
+      case RUN    : mc.run( iso ) ;  m.assign( mc ) ; break ;
+      case SEEDED : mc.run_seeded( iso, std::vector<glm::ivec3>(), 1 ) ;  m.assign( mc ) ; break ;
+      case BRICKS : { BrickExtractor bx( 3, brick ) ;  bx.run( mc, iso ) ;  m.assign( mc ) ; } break ;
+      case PIPELINE :
+        {
+          MeshPipeline pipe( slab, 2 ) ;
+          MeshWriter   out ;
+          if( !out.open( tmp.c_str() ) ) { fail( engine_names[e], "cannot write " + tmp ) ;  continue ; }
+          pipe.run( size, sample, out, iso, glm::vec3( 0.0f ), glm::vec3( 1.0f ), original ) ;
+          if( !out.close() || !MeshReader::read( tmp.c_str(), m.verts, m.trigs ) ) { fail( engine_names[e], "cannot read back " + tmp ) ;  continue ; }
+        }
+        break ;
+      case DISTRIBUTED :
+        {
+          // the grid of mc is not used, only its size and method
+          DistributedExtractor dx( 2, brick ) ;
+          mc.set_resolution( size.x, size.y, size.z ) ;
+          mc.set_method( original ) ;
+          if( !dx.run( mc, sample, iso ) ) { fail( engine_names[e], "cannot run the workers" ) ;  continue ; }
+          m.assign( mc ) ;
+        }
+        break ;
+      }
+
+      canonical( m, v, t ) ;
+      char msg[128] ;
+      if( v != refv )
+      {
+        snprintf( msg, sizeof(msg), "vertices differ : %d instead of %d", (int)v.size(), (int)refv.size() ) ;
+        fail( engine_names[e], msg ) ;
+        continue ;
+      }
+      if( t != reft )
+      {
+        snprintf( msg, sizeof(msg), "triangles differ : %d instead of %d", (int)t.size(), (int)reft.size() ) ;
+        fail( engine_names[e], msg ) ;
+        continue ;
+      }
+      const std::string wrong = check_normals( m, refn ) ;
+      if( !wrong.empty() ) { fail( engine_names[e], wrong ) ;  continue ; }
+      if( original || !ref_defect.empty() ) continue ;
+      int euler = 0 ;
+      const std::string defect = check_manifold( m, size, closed, euler ) ;
+      if( !defect.empty() ) fail( engine_names[e], defect ) ;
+      else if( euler != ref_euler )
+      {
+        snprintf( msg, sizeof(msg), "Euler characteristic %d instead of %d", euler, ref_euler ) ;
+        fail( engine_names[e], msg ) ;
+      }
+    }
+
+    if( verbose )
+      printf( "iteration %d : %s %dx%dx%d iso %g%s%s, %d vertices, %d triangles, Euler %d\n", it, kind_names[kind],
+              size.x, size.y, size.z, iso, closed ? " closed" : "", original ? " original" : "",
+              (int)refm.verts.size(), (int)refm.trigs.size(), ref_euler ) ;
+  }
+  remove( tmp.c_str() ) ;
+
+  printf( "%d iterations, %d failures, %d reference defects\n", iters, failures, defects ) ;
+  return failures ? 1 : 0 ;
+}
+//_____________________________________________________________________________